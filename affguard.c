@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Arbitration of FahCore's own sched_setaffinity() calls (GROMACS pins
+ * its threads when it thinks nobody else did). A seccomp filter installed
+ * right before exec makes the call stop with PTRACE_EVENT_SECCOMP before
+ * it's carried out; depending on policy the call is let through, skipped
+ * with the thread (re)bound to the cpu planned for it, or skipped with
+ * EPERM. Every call gets logged along with what became of it.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <sched.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#include "affguard.h"
+#include "task.h"
+#include "topology.h"
+#include "llog.h"
+
+/* to be called by FahCore child before exec; needs PTRACE_O_TRACESECCOMP */
+int affguard_install(void)
+{
+	struct sock_filter filter[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_sched_setaffinity, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+	};
+	struct sock_fprog prog = { sizeof(filter) / sizeof(*filter), filter };
+
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0)) {
+		return -1;
+	}
+	return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
+}
+
+/* mask requested by 'tid' at 'addr' ('size' bytes) as a cpu list */
+static char *requested(pid_t tid, unsigned long addr, size_t size, char *buf, size_t bufsize)
+{
+	size_t setsize = CPU_ALLOC_SIZE(topo_nr_cpus());
+	cpu_set_t *set = CPU_ALLOC(topo_nr_cpus());
+	struct iovec local = { set, size < setsize ? size : setsize };
+	struct iovec remote = { (void *)addr, local.iov_len };
+
+	CPU_ZERO_S(setsize, set);
+	if (process_vm_readv(tid, &local, 1, &remote, 1, 0) < 0) {
+		snprintf(buf, bufsize, "?");
+	} else {
+		topo_format_cpulist(set, setsize, buf, bufsize);
+	}
+	CPU_FREE(set);
+	return buf;
+}
+
+/* makes the syscall 'tid' is stopped at return 'ret' without being carried out */
+static void skip(pid_t tid, struct user_regs_struct *regs, long ret)
+{
+	regs->orig_rax = -1;
+	regs->rax = ret;
+	ptrace(PTRACE_SETREGS, tid, NULL, regs);
+}
+
+/*
+ * To be called at PTRACE_EVENT_SECCOMP stop of sched_setaffinity() made
+ * by 'tid'; applies 'policy' (AFF_*). Returns 1 if the call was let
+ * through, 0 if it was skipped.
+ */
+int affguard_syscall(pid_t tid, struct user_regs_struct *regs, int policy)
+{
+	pid_t target = regs->rdi ? regs->rdi : tid;
+	struct task *t = task_find(target);
+	char list[256];
+
+	requested(tid, regs->rdx, regs->rsi, list, sizeof(list));
+	switch (policy) {
+		case AFF_REWRITE:
+			if (!t || t->cpu < 0) {
+				break;
+			}
+			if (topo_bind(target, t->cpu)) {
+				llog("thekraken: %d: sched_setaffinity(%d, cpus %s): keeping cpu %d failed: %s; allowed\n", tid, target, list, t->cpu, strerror(errno));
+				return 1;
+			}
+			llog("thekraken: %d: sched_setaffinity(%d, cpus %s): kept on cpu %d\n", tid, target, list, t->cpu);
+			skip(tid, regs, 0);
+			return 0;
+		case AFF_DENY:
+			llog("thekraken: %d: sched_setaffinity(%d, cpus %s): denied\n", tid, target, list);
+			skip(tid, regs, -EPERM);
+			return 0;
+	}
+	llog("thekraken: %d: sched_setaffinity(%d, cpus %s): allowed%s\n", tid, target, list, policy == AFF_REWRITE ? " (no cpu planned)" : "");
+	return 1;
+}
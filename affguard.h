@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __AFFGUARD_H
+#define __AFFGUARD_H
+
+#include <sys/types.h>
+#include <sys/user.h>
+
+#define AFF_OFF 0	/* not intercepted */
+#define AFF_LOG 1	/* logged and allowed */
+#define AFF_REWRITE 2	/* threads with a planned cpu stay there */
+#define AFF_DENY 3	/* fails with EPERM */
+#define AFF_MAX 4
+
+int affguard_install(void);
+int affguard_syscall(pid_t tid, struct user_regs_struct *regs, int policy);
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Attaching to FahCore that is already running (started unwrapped): all
+ * its threads are seized with PTRACE_SEIZE and stopped with
+ * PTRACE_INTERRUPT, so none can clone behind our back while threads get
+ * classified and bound.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+
+#include "attach.h"
+
+static int tid_cmp(const void *a, const void *b)
+{
+	return *(const pid_t *)a - *(const pid_t *)b;
+}
+
+static int known(pid_t *tids, int n, pid_t tid)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (tids[i] == tid)
+			return 1;
+	}
+	return 0;
+}
+
+/* seizes 'tid' and waits until it stops */
+static int seize(pid_t tid)
+{
+	int status;
+
+	if (ptrace(PTRACE_SEIZE, tid, 0, 0) || ptrace(PTRACE_INTERRUPT, tid, 0, 0)) {
+		return -1;
+	}
+	while (waitpid(tid, &status, __WALL) == tid) {
+		if (!WIFSTOPPED(status)) {
+			errno = ESRCH;
+			return -1;
+		}
+		if ((status >> 16) == PTRACE_EVENT_STOP) {
+			return 0;
+		}
+		/* signal on its way; deliver it, interrupt is still pending */
+		ptrace(PTRACE_CONT, tid, 0, WSTOPSIG(status));
+	}
+	return -1;
+}
+
+/*
+ * Seizes all threads of 'pid', rescanning until no new ones show up; fills
+ * 'tids' (up to 'max' entries) with main thread followed by the others in
+ * creation (tid) order. Returns number of
+ * threads seized or -1 (errno set) if 'pid' itself couldn't be.
+ */
+int attach_seize(pid_t pid, pid_t *tids, int max)
+{
+	char fn[32];
+	int n = 0, added;
+
+	if (seize(pid)) {
+		return -1;
+	}
+	tids[n++] = pid;
+	do {
+		DIR *d;
+		struct dirent *de;
+
+		added = 0;
+		snprintf(fn, sizeof(fn), "/proc/%d/task", pid);
+		d = opendir(fn);
+		if (!d) {
+			break;
+		}
+		while ((de = readdir(d)) && n < max) {
+			pid_t tid = atoi(de->d_name);
+
+			if (tid <= 0 || known(tids, n, tid))
+				continue;
+			if (!seize(tid)) {
+				tids[n++] = tid;
+				added++;
+			}
+		}
+		closedir(d);
+	} while (added);
+
+	/* main thread stays first */
+	qsort(tids + 1, n - 1, sizeof(*tids), tid_cmp);
+	return n;
+}
+
+/* sets ptrace 'options' on all (stopped) threads and lets them run */
+void attach_resume(pid_t *tids, int n, int options)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		ptrace(PTRACE_SETOPTIONS, tids[i], 0, options);
+		ptrace(PTRACE_CONT, tids[i], 0, 0);
+	}
+}
+
+/* detaches from all (stopped) threads; returns number of threads detached */
+int attach_release(pid_t *tids, int n)
+{
+	int i, r = 0;
+
+	for (i = 0; i < n; i++) {
+		if (!ptrace(PTRACE_DETACH, tids[i], 0, 0))
+			r++;
+	}
+	return r;
+}
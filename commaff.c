@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Communication affinity: during first minutes after first step, futex
+ * wait/wake pairs of compute threads are sampled (through the syscall hook)
+ * to build communication graph. Once learning period is over, threads get
+ * re-pinned so that heavily communicating groups share last level cache
+ * (or node, if there's no LLC sharing among used cpus).
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/user.h>
+
+#include "commaff.h"
+#include "topology.h"
+#include "task.h"
+#include "llog.h"
+
+#define CA_MAX 256		/* threads taking part in learning */
+#define CA_HASH 4096		/* futex words tracked */
+#define CA_WAITERS 8		/* waiters remembered per futex word */
+
+#define FUTEX_CMD_MASK ~(128 | 256) /* FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME */
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_WAKE_OP 5
+#define FUTEX_WAIT_BITSET 9
+#define FUTEX_WAKE_BITSET 10
+
+#define STATE_TRACING 1		/* tracing, waiting for first step */
+#define STATE_RECORDING 2
+#define STATE_DONE 3
+
+struct futex {
+	unsigned long uaddr;
+	short waiters[CA_WAITERS];
+	int nwaiters;
+};
+
+static int state;
+static unsigned int _period;
+static time_t rec_start;
+static unsigned long nsamples;
+
+static pid_t tids[CA_MAX];
+static int ntids;
+static unsigned int *weight; /* CA_MAX x CA_MAX, symmetric */
+static struct futex *futexes;
+
+#define W(a, b) weight[(a) * CA_MAX + (b)]
+
+void commaff_init(unsigned int period)
+{
+	_period = period;
+	weight = calloc(CA_MAX * CA_MAX, sizeof(*weight));
+	futexes = calloc(CA_HASH, sizeof(*futexes));
+	if (weight && futexes) {
+		state = STATE_TRACING;
+	}
+}
+
+static int lookup(pid_t tid)
+{
+	int i;
+
+	for (i = 0; i < ntids; i++) {
+		if (tids[i] == tid)
+			return i;
+	}
+	return -1;
+}
+
+void commaff_add(pid_t tid)
+{
+	if (state != STATE_TRACING || ntids == CA_MAX) {
+		return;
+	}
+	tids[ntids++] = tid;
+}
+
+void commaff_start(void)
+{
+	if (state != STATE_TRACING) {
+		return;
+	}
+	llog("thekraken: commaff: learning communication pattern of %d threads for %u seconds\n", ntids, _period);
+	rec_start = time(NULL);
+	state = STATE_RECORDING;
+}
+
+int commaff_tracing(pid_t tid)
+{
+	return (state == STATE_TRACING || state == STATE_RECORDING) && lookup(tid) >= 0;
+}
+
+static struct futex *futex_slot(unsigned long uaddr)
+{
+	struct futex *f = &futexes[(uaddr >> 2) % CA_HASH];
+
+	if (f->uaddr != uaddr) {
+		/* evict whatever was there */
+		f->uaddr = uaddr;
+		f->nwaiters = 0;
+	}
+	return f;
+}
+
+static void wait_event(int idx, unsigned long uaddr)
+{
+	struct futex *f = futex_slot(uaddr);
+	int i;
+
+	for (i = 0; i < f->nwaiters; i++) {
+		if (f->waiters[i] == idx)
+			return;
+	}
+	if (f->nwaiters < CA_WAITERS) {
+		f->waiters[f->nwaiters++] = idx;
+	}
+}
+
+static void wake_event(int idx, unsigned long uaddr)
+{
+	struct futex *f = futex_slot(uaddr);
+	int i;
+
+	for (i = 0; i < f->nwaiters; i++) {
+		int w = f->waiters[i];
+
+		if (w == idx)
+			continue;
+		W(idx, w)++;
+		W(w, idx)++;
+		nsamples++;
+	}
+	f->nwaiters = 0;
+}
+
+static void log_graph(void)
+{
+	int a, b;
+
+	/* strongest partner of each thread; whole graph only if asked to be verbose */
+	for (a = 0; a < ntids; a++) {
+		unsigned int best = 0;
+		int bb = -1;
+
+		for (b = 0; b < ntids; b++) {
+			if (W(a, b) > best) {
+				best = W(a, b);
+				bb = b;
+			}
+		}
+		if (bb >= 0)
+			llog("thekraken: commaff: %d talks most to %d (%u wakeups)\n", tids[a], tids[bb], best);
+	}
+	debug(2) {
+		for (a = 0; a < ntids; a++) {
+			for (b = a + 1; b < ntids; b++) {
+				if (W(a, b))
+					llog("thekraken: commaff: graph %d -- %d: %u\n", tids[a], tids[b], W(a, b));
+			}
+		}
+	}
+}
+
+/*
+ * Greedily fills every cache group (in order of size) with the unassigned
+ * thread communicating most, followed by threads communicating most with
+ * the group so far; cpus stay the same set, only the mapping changes.
+ */
+static void remap(void)
+{
+	int cpus[CA_MAX], slots[CA_MAX], group[CA_MAX], members[CA_MAX], newcpu[CA_MAX];
+	int assigned[CA_MAX];
+	int idx[CA_MAX];
+	int n = 0, ngroups = 0, level;
+	int i, j, g;
+
+	for (i = 0; i < ntids; i++) {
+		struct task *t = task_find(tids[i]);
+
+		if (!t || t->cpu < 0)
+			continue;
+		idx[n] = i;
+		cpus[n] = t->cpu;
+		slots[n] = t->slot;
+		assigned[n] = 0;
+		newcpu[n] = -1;
+		n++;
+	}
+	if (n < 2) {
+		llog("thekraken: commaff: fewer than two bound threads, nothing to re-pin\n");
+		return;
+	}
+
+	/* group by LLC; if all cpus share one, try nodes */
+	for (level = 0; level < 2; level++) {
+		int ids[CA_MAX];
+
+		ngroups = 0;
+		for (i = 0; i < n; i++) {
+			int id = level == 0 ? topo_cpu_llc(cpus[i]) : topo_cpu_node(cpus[i]);
+
+			for (j = 0; j < ngroups; j++) {
+				if (ids[j] == id)
+					break;
+			}
+			if (j == ngroups)
+				ids[ngroups++] = id;
+			group[i] = j;
+		}
+		if (ngroups > 1)
+			break;
+	}
+	if (ngroups < 2) {
+		llog("thekraken: commaff: all threads share %s, nothing to re-pin\n", level == 0 ? "last level cache" : "node");
+		return;
+	}
+
+	for (g = 0; g < ngroups; g++) {
+		int size = 0, nm = 0;
+
+		for (i = 0; i < n; i++) {
+			if (group[i] == g)
+				size++;
+		}
+		while (nm < size) {
+			long best = -1;
+			int bi = -1;
+
+			for (i = 0; i < n; i++) {
+				long w = 0;
+				int k;
+
+				if (assigned[i])
+					continue;
+				if (nm == 0) {
+					/* seed: strongest unassigned thread */
+					for (k = 0; k < n; k++) {
+						if (!assigned[k])
+							w += W(idx[i], idx[k]);
+					}
+				} else {
+					for (k = 0; k < nm; k++)
+						w += W(idx[i], idx[members[k]]);
+				}
+				if (w > best) {
+					best = w;
+					bi = i;
+				}
+			}
+			if (bi < 0)
+				break;
+			assigned[bi] = 1;
+			members[nm++] = bi;
+		}
+		/* members already within the group keep their cpus */
+		for (i = 0; i < nm; i++) {
+			if (group[members[i]] == g)
+				newcpu[members[i]] = cpus[members[i]];
+		}
+		for (i = 0; i < nm; i++) {
+			int m = members[i];
+
+			if (newcpu[m] >= 0)
+				continue;
+			for (j = 0; j < n; j++) {
+				int k, taken = 0;
+
+				if (group[j] != g)
+					continue;
+				for (k = 0; k < nm; k++) {
+					if (newcpu[members[k]] == cpus[j])
+						taken = 1;
+				}
+				if (!taken) {
+					newcpu[m] = cpus[j];
+					break;
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		struct task *t = task_find(tids[idx[i]]);
+
+		if (newcpu[i] < 0 || !t)
+			continue;
+		llog("thekraken: commaff: mapping %d: cpu %d -> cpu %d (group %d)\n", t->tid, cpus[i], newcpu[i], level == 0 ? topo_cpu_llc(newcpu[i]) : topo_cpu_node(newcpu[i]));
+		if (newcpu[i] != cpus[i]) {
+			if (topo_bind(t->tid, newcpu[i])) {
+				llog("thekraken: commaff: binding %d to cpu %d failed: %s\n", t->tid, newcpu[i], strerror(errno));
+				continue;
+			}
+			t->cpu = newcpu[i];
+			/* the slot goes with the cpu, so that's what gets freed on exit */
+			for (j = 0; j < n; j++) {
+				if (cpus[j] == newcpu[i])
+					t->slot = slots[j];
+			}
+		}
+	}
+}
+
+static void finish(void)
+{
+	state = STATE_DONE;
+	llog("thekraken: commaff: learning complete, %lu wakeup samples\n", nsamples);
+	if (nsamples) {
+		log_graph();
+		remap();
+	}
+	free(weight);
+	free(futexes);
+	weight = NULL;
+	futexes = NULL;
+}
+
+/*
+ * Syscall hook; to be called at every syscall stop of a thread for which
+ * commaff_tracing() returns true. Returns whether the thread should
+ * remain syscall-traced.
+ */
+int commaff_syscall(pid_t tid, struct user_regs_struct *regs)
+{
+	int idx;
+
+	if (state == STATE_RECORDING && time(NULL) - rec_start >= _period) {
+		finish();
+		return 0;
+	}
+	idx = lookup(tid);
+	if (idx < 0 || state != STATE_RECORDING) {
+		return idx >= 0 && state == STATE_TRACING;
+	}
+	/* syscall entry (x86-64: rax holds -ENOSYS) */
+	if (regs->orig_rax == SYS_futex && (long)regs->rax == -ENOSYS) {
+		switch (regs->rsi & FUTEX_CMD_MASK) {
+			case FUTEX_WAIT:
+			case FUTEX_WAIT_BITSET:
+				wait_event(idx, regs->rdi);
+				break;
+			case FUTEX_WAKE:
+			case FUTEX_WAKE_BITSET:
+				wake_event(idx, regs->rdi);
+				break;
+			case FUTEX_WAKE_OP:
+				wake_event(idx, regs->rdi);
+				wake_event(idx, regs->r8);
+				break;
+		}
+	}
+	return 1;
+}
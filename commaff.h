@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __COMMAFF_H
+#define __COMMAFF_H
+
+#include <sys/types.h>
+#include <sys/user.h>
+
+void commaff_init(unsigned int period);
+void commaff_add(pid_t tid);
+void commaff_start(void);
+int commaff_tracing(pid_t tid);
+int commaff_syscall(pid_t tid, struct user_regs_struct *regs);
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Control socket. Every wrapper listens on CTL_FMT (in the client
+ * directory) for single line commands; the reply is sent back over the
+ * same connection which is then closed. See 'thekraken -C'.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <sys/un.h>
+
+#include "ctl.h"
+#include "llog.h"
+
+#define CTL_TIMEOUT 1 /* seconds a client gets to send its command */
+
+static int lfd = -1;
+static struct sockaddr_un addr;
+
+static int cfd = -1;
+static time_t cstart;
+static char cbuf[CTL_CMD_SIZE];
+static int clen;
+
+/* returns listening socket; -1 on error */
+int ctl_init(void)
+{
+	mode_t mask;
+
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), CTL_FMT, getpid());
+	unlink(addr.sun_path);
+
+	lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (lfd == -1) {
+		return -1;
+	}
+	/* owner only; commands affect FahCore */
+	mask = umask(0077);
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) || listen(lfd, 4)) {
+		umask(mask);
+		close(lfd);
+		lfd = -1;
+		return -1;
+	}
+	umask(mask);
+	llog("thekraken: control socket: %s\n", addr.sun_path);
+	return lfd;
+}
+
+int ctl_fd(void)
+{
+	return lfd;
+}
+
+/* connection whose command hasn't been read in full yet */
+int ctl_conn_fd(void)
+{
+	return cfd;
+}
+
+/* poll() timeout; pending connection gets dropped after CTL_TIMEOUT */
+int ctl_timeout(void)
+{
+	return cfd != -1 ? CTL_TIMEOUT * 1000 : -1;
+}
+
+/*
+ * Accepts pending connection and reads whatever it sent so far; neither
+ * blocks. Once the command (up to newline) is complete, it's put into
+ * 'cmd' and the connection to reply to is returned; -1 otherwise.
+ * Connections not done within CTL_TIMEOUT seconds are dropped.
+ */
+int ctl_read(char *cmd, int size)
+{
+	int fd, n = -1;
+	char *nl;
+
+	if (cfd != -1 && time(NULL) - cstart > CTL_TIMEOUT) {
+		debug(1) llog("thekraken: control: connection timed out\n");
+		close(cfd);
+		cfd = -1;
+	}
+	if (cfd == -1) {
+		cfd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (cfd == -1) {
+			return -1;
+		}
+		cstart = time(NULL);
+		clen = 0;
+	}
+	while (clen < sizeof(cbuf) - 1 && (n = read(cfd, cbuf + clen, sizeof(cbuf) - 1 - clen)) > 0) {
+		clen += n;
+		cbuf[clen] = '\0';
+		if (strchr(cbuf, '\n'))
+			break;
+	}
+	cbuf[clen] = '\0';
+	nl = strchr(cbuf, '\n');
+	if (!nl && clen < sizeof(cbuf) - 1 && n != 0) {
+		/* more to come */
+		return -1;
+	}
+	fd = cfd;
+	cfd = -1;
+	if (nl) {
+		*nl = '\0';
+	}
+	if (clen == 0) {
+		close(fd);
+		return -1;
+	}
+	snprintf(cmd, size, "%s", cbuf);
+	debug(1) llog("thekraken: control: '%s'\n", cmd);
+	return fd;
+}
+
+/* sends reply and closes the connection */
+void ctl_reply(int fd, const char *fmt, ...)
+{
+	char buf[1024];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (n >= sizeof(buf)) {
+		n = sizeof(buf) - 1;
+	}
+	/* client might be gone already; no SIGPIPE for us then */
+	send(fd, buf, n, MSG_NOSIGNAL);
+	/* children forked meanwhile (synthload) hold copies of 'fd'; make sure the client sees EOF */
+	shutdown(fd, SHUT_RDWR);
+	close(fd);
+}
+
+void ctl_cleanup(void)
+{
+	if (cfd != -1) {
+		close(cfd);
+		cfd = -1;
+	}
+	if (lfd != -1) {
+		close(lfd);
+		unlink(addr.sun_path);
+		lfd = -1;
+	}
+}
+
+/* client side; sends 'cmd' to wrapper listening on 'path' and prints the reply */
+int ctl_send(const char *path, const char *cmd)
+{
+	struct sockaddr_un sa;
+	char buf[1024];
+	int fd, n;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", path);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1 || connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		llog("thekraken: %s: %s\n", path, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+	dprintf(fd, "%s\n", cmd);
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		fwrite(buf, 1, n, stdout);
+	}
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __CTL_H
+#define __CTL_H
+
+#define CTL_FMT "thekraken-%d.sock"
+#define CTL_CMD_SIZE 256
+
+int ctl_init(void);
+int ctl_fd(void);
+int ctl_conn_fd(void);
+int ctl_timeout(void);
+int ctl_read(char *cmd, int size);
+void ctl_reply(int fd, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
+void ctl_cleanup(void);
+int ctl_send(const char *path, const char *cmd);
+
+#endif
@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Energy accounting from RAPL counters: powercap zones (intel-rapl, which
+ * also covers AMD family 17h and later, and amd-rapl where present) or,
+ * failing that, the amd_energy hwmon driver. Package and DRAM energy are
+ * summed over all sockets, sampled every ENERGY_PERIOD ms so counters
+ * can't wrap more than once between samples, and split three ways:
+ *
+ *   per frame - frames end with 'Completed' lines of FahCore's logfile,
+ *               which is tailed on every sample (FahCore's writes are
+ *               traced only until DLB engages)
+ *   per phase - named by energy_phase() (startup, dlbload, run)
+ *   per WU    - from energy_init() to energy_report()
+ *
+ * All paths go through topo_path().
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "energy.h"
+#include "logscan.h"
+#include "topology.h"
+#include "llog.h"
+
+#define POWERCAP_DIR "/sys/class/powercap"
+#define HWMON_DIR "/sys/class/hwmon"
+#define ENERGY_PERIOD 1000 /* ms */
+#define ENERGY_MAX_ZONES 32
+
+struct zone {
+	char fn[PATH_MAX];	/* energy counter, uJ */
+	int domain;		/* ENERGY_* */
+	uint64_t max;		/* counter wraps past this; 0 if it doesn't */
+	uint64_t last;
+};
+
+/* energy (uJ) and time (ms) since some point */
+struct mark {
+	uint64_t uj[ENERGY_DOMAINS];
+	long ms;
+};
+
+static struct zone zones[ENERGY_MAX_ZONES];
+static int nzones;
+static int has[ENERGY_DOMAINS];
+static uint64_t total[ENERGY_DOMAINS]; /* accumulated since energy_init() */
+static struct timespec t0;
+static int tfd = -1;
+
+static char logfn[32]; /* empty until the first step */
+static off_t logoff;
+static struct logscan ls;
+static int frames;
+static double frames_j; /* energy of all frames so far */
+static struct mark frame, phase;
+static char phase_name[16] = "startup";
+
+static int read_u64(const char *fn, uint64_t *v)
+{
+	char buf[32];
+	int fd, n;
+
+	fd = open(fn, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return -1;
+	buf[n] = '\0';
+	*v = strtoull(buf, NULL, 10);
+	return 0;
+}
+
+static int read_str(const char *fn, char *buf, int size)
+{
+	int fd, n;
+
+	fd = open(fn, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	n = read(fd, buf, size - 1);
+	close(fd);
+	if (n <= 0)
+		return -1;
+	buf[n] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
+}
+
+/* adds counter 'fn' of 'domain'; -1 with errno set if it can't be read */
+static int add_zone(const char *fn, int domain, uint64_t max)
+{
+	struct zone *z = &zones[nzones];
+
+	if (nzones == ENERGY_MAX_ZONES) {
+		errno = ENOSPC;
+		return -1;
+	}
+	snprintf(z->fn, sizeof(z->fn), "%s", fn);
+	if (read_u64(z->fn, &z->last)) {
+		return -1;
+	}
+	z->domain = domain;
+	z->max = max;
+	has[domain] = 1;
+	nzones++;
+	return 0;
+}
+
+/* powercap zones; subzones (intel-rapl:0:1) are listed next to their parents */
+static int scan_powercap(int *denied)
+{
+	char fn[PATH_MAX], name[32];
+	struct dirent *de;
+	DIR *d;
+	uint64_t max;
+	int n = 0, domain;
+
+	d = opendir(topo_path(fn, sizeof(fn), POWERCAP_DIR));
+	if (!d) {
+		return 0;
+	}
+	while ((de = readdir(d))) {
+		if (strncmp(de->d_name, "intel-rapl:", 11) && strncmp(de->d_name, "amd-rapl:", 9))
+			continue;
+		topo_path(fn, sizeof(fn), POWERCAP_DIR "/%s/name", de->d_name);
+		if (read_str(fn, name, sizeof(name)))
+			continue;
+		if (!strncmp(name, "package-", 8)) {
+			domain = ENERGY_PKG;
+		} else if (!strcmp(name, "dram")) {
+			domain = ENERGY_DRAM;
+		} else {
+			/* core, uncore, psys: part of or overlapping with package */
+			continue;
+		}
+		topo_path(fn, sizeof(fn), POWERCAP_DIR "/%s/max_energy_range_uj", de->d_name);
+		if (read_u64(fn, &max)) {
+			max = 0;
+		}
+		topo_path(fn, sizeof(fn), POWERCAP_DIR "/%s/energy_uj", de->d_name);
+		if (add_zone(fn, domain, max)) {
+			if (errno == EACCES || errno == EPERM)
+				(*denied)++;
+			continue;
+		}
+		n++;
+	}
+	closedir(d);
+	return n;
+}
+
+/* amd_energy hwmon driver: per-socket (Esocket*) counters only, no DRAM */
+static int scan_hwmon(int *denied)
+{
+	char fn[PATH_MAX], name[32];
+	struct dirent *de;
+	DIR *d;
+	int n = 0, i;
+
+	d = opendir(topo_path(fn, sizeof(fn), HWMON_DIR));
+	if (!d) {
+		return 0;
+	}
+	while ((de = readdir(d))) {
+		if (strncmp(de->d_name, "hwmon", 5))
+			continue;
+		topo_path(fn, sizeof(fn), HWMON_DIR "/%s/name", de->d_name);
+		if (read_str(fn, name, sizeof(name)) || strcmp(name, "amd_energy"))
+			continue;
+		for (i = 1; ; i++) {
+			topo_path(fn, sizeof(fn), HWMON_DIR "/%s/energy%d_label", de->d_name, i);
+			if (read_str(fn, name, sizeof(name)))
+				break;
+			if (strncmp(name, "Esocket", 7))
+				continue;
+			topo_path(fn, sizeof(fn), HWMON_DIR "/%s/energy%d_input", de->d_name, i);
+			/* the driver accumulates into 64 bits itself */
+			if (add_zone(fn, ENERGY_PKG, 0)) {
+				if (errno == EACCES || errno == EPERM)
+					(*denied)++;
+				continue;
+			}
+			n++;
+		}
+	}
+	closedir(d);
+	return n;
+}
+
+/*
+ * Finds energy counters and starts sampling them (poll energy_fd() and
+ * call energy_tick()). Returns number of them, 0 if there are none, -1
+ * with errno EACCES if there are some but none is readable (counters are
+ * root-only on kernels mitigating CVE-2020-8694) or errno of a timerfd
+ * failure.
+ */
+int energy_init(void)
+{
+	struct itimerspec its = { { ENERGY_PERIOD / 1000, (ENERGY_PERIOD % 1000) * 1000000 }, { ENERGY_PERIOD / 1000, (ENERGY_PERIOD % 1000) * 1000000 } };
+	int denied = 0;
+
+	nzones = 0;
+	memset(has, 0, sizeof(has));
+	memset(total, 0, sizeof(total));
+	memset(&phase, 0, sizeof(phase));
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (scan_powercap(&denied) == 0) {
+		scan_hwmon(&denied);
+	}
+	if (nzones == 0 && denied) {
+		errno = EACCES;
+		return -1;
+	}
+	if (nzones == 0) {
+		return 0;
+	}
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (tfd == -1 || timerfd_settime(tfd, 0, &its, NULL)) {
+		return -1;
+	}
+	return nzones;
+}
+
+static void sample(void)
+{
+	uint64_t v;
+	int i;
+
+	for (i = 0; i < nzones; i++) {
+		struct zone *z = &zones[i];
+
+		if (read_u64(z->fn, &v))
+			continue;
+		if (v >= z->last) {
+			total[z->domain] += v - z->last;
+		} else if (z->max) {
+			total[z->domain] += z->max - z->last + v;
+		}
+		z->last = v;
+	}
+}
+
+static void mark(struct mark *m)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	memcpy(m->uj, total, sizeof(total));
+	m->ms = (t.tv_sec - t0.tv_sec) * 1000 + (t.tv_nsec - t0.tv_nsec) / 1000000;
+}
+
+/*
+ * Logs energy used since 'from' as "<what>: ..." and moves 'from' to now;
+ * returns package and DRAM energy in J.
+ */
+static double report_since(struct mark *from, const char *what)
+{
+	struct mark now;
+	double pkg, dram, s;
+
+	sample();
+	mark(&now);
+	pkg = (now.uj[ENERGY_PKG] - from->uj[ENERGY_PKG]) / 1e6;
+	dram = (now.uj[ENERGY_DRAM] - from->uj[ENERGY_DRAM]) / 1e6;
+	s = (now.ms - from->ms) / 1e3;
+	if (has[ENERGY_DRAM]) {
+		llog("thekraken: energy: %s: %.0f J package, %.0f J DRAM in %.0fs (%.1f W)\n", what, pkg, dram, s, s > 0 ? (pkg + dram) / s : 0);
+	} else {
+		llog("thekraken: energy: %s: %.0f J package in %.0fs (%.1f W)\n", what, pkg, s, s > 0 ? pkg / s : 0);
+	}
+	*from = now;
+	return pkg + dram;
+}
+
+/*
+ * Starts per frame accounting once FahCore reported its first step in
+ * logfile_'slot'.txt.
+ */
+void energy_start(const char *slot)
+{
+	char buf[4096];
+	ssize_t n;
+	int fd;
+
+	if (tfd == -1) {
+		return;
+	}
+	/* frames are counted from the first step on */
+	snprintf(logfn, sizeof(logfn), "work/logfile_%s.txt", slot);
+	logscan_init(&ls, "energy");
+	logoff = 0;
+	fd = open(logfn, O_RDONLY | O_CLOEXEC);
+	if (fd != -1) {
+		while ((n = pread(fd, buf, sizeof(buf), logoff)) > 0) {
+			logoff += n;
+			logscan_feed(&ls, buf, n);
+		}
+		close(fd);
+	}
+	frames = 0;
+	frames_j = 0;
+	sample();
+	mark(&frame);
+}
+
+int energy_fd(void)
+{
+	return tfd;
+}
+
+/* samples counters and looks for finished frames if energy_fd() is readable */
+void energy_tick(void)
+{
+	unsigned long long expirations;
+	char buf[4096], what[32];
+	ssize_t n;
+	int fd;
+
+	if (tfd == -1 || read(tfd, &expirations, sizeof(expirations)) <= 0) {
+		return;
+	}
+	sample();
+	if (!logfn[0] || (fd = open(logfn, O_RDONLY | O_CLOEXEC)) == -1) {
+		return;
+	}
+	while ((n = pread(fd, buf, sizeof(buf), logoff)) > 0) {
+		int events = logscan_feed(&ls, buf, n);
+
+		logoff += n;
+		if (events & LOGSCAN_FIRST_STEP) {
+			/* one sample per 'Completed' line is plenty for frames minutes long */
+			snprintf(what, sizeof(what), "frame %d", ++frames);
+			frames_j += report_since(&frame, what);
+		}
+	}
+	close(fd);
+}
+
+/* ends the current phase (logging its energy) and starts phase 'name' */
+void energy_phase(const char *name)
+{
+	char what[32];
+
+	if (tfd == -1 || !strcmp(name, phase_name)) {
+		return;
+	}
+	snprintf(what, sizeof(what), "phase %s", phase_name);
+	report_since(&phase, what);
+	snprintf(phase_name, sizeof(phase_name), "%s", name);
+}
+
+/* logs energy of the last phase and the WU so far; stops sampling */
+void energy_report(void)
+{
+	struct mark start;
+
+	if (tfd == -1) {
+		return;
+	}
+	memset(&start, 0, sizeof(start));
+	energy_phase("");
+	report_since(&start, "WU");
+	if (frames > 0) {
+		llog("thekraken: energy: %.0f J per frame (%d frame(s))\n", frames_j / frames, frames);
+	}
+	close(tfd);
+	tfd = -1;
+}
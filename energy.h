@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __ENERGY_H
+#define __ENERGY_H
+
+#define ENERGY_PKG 0
+#define ENERGY_DRAM 1
+#define ENERGY_DOMAINS 2
+
+int energy_init(void);
+void energy_start(const char *slot);
+int energy_fd(void);
+void energy_tick(void);
+void energy_phase(const char *name);
+void energy_report(void);
+
+#endif
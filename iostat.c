@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Checkpoint I/O instrumentation. A seccomp filter installed right before
+ * exec of FahCore makes file related syscalls (and only these) stop with
+ * PTRACE_EVENT_SECCOMP; the thread is then resumed with PTRACE_SYSCALL so
+ * that the exit stop gives us duration and result of the call. I/O done
+ * to files under work/ is accounted per checkpoint (burst of I/O) and per
+ * frame (as seen in FahCore's logfile).
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#include "iostat.h"
+#include "llog.h"
+
+#ifndef SYS_renameat2
+#define SYS_renameat2 316
+#endif
+
+#define IOSTAT_MAX_FD 4096
+#define IOSTAT_MAX_PENDING 64
+#define IOSTAT_BURST_GAP 1000.0	/* ms of work/ I/O silence ending a checkpoint */
+
+#define KIND_OPEN 0
+#define KIND_CLOSE 1
+#define KIND_WRITE 2
+#define KIND_FSYNC 3
+#define KIND_RENAME 4
+
+#define FD_WORK 1
+#define FD_LOG 2
+
+struct pending {
+	pid_t tid;
+	int kind;
+	int fd;
+	int flags;	/* FD_* of the file involved (or being opened) */
+	int frame;	/* write of a "Completed" line to the logfile */
+	double start;
+};
+
+struct io {
+	double write_ms;
+	double fsync_ms;
+	double rename_ms;
+	unsigned long long bytes;
+	int ops;
+};
+
+static const int traced[] = {
+	SYS_open, SYS_openat, SYS_creat, SYS_close,
+	SYS_write, SYS_pwrite64, SYS_writev, SYS_pwritev,
+	SYS_fsync, SYS_fdatasync,
+	SYS_rename, SYS_renameat, SYS_renameat2,
+};
+
+static unsigned char fds[IOSTAT_MAX_FD];
+static struct pending pending[IOSTAT_MAX_PENDING];
+
+static struct io burst, total;
+static double burst_last;
+static int checkpoints;
+
+static double frame_last, frame_io_ms;
+static double frames_wall_ms, frames_io_ms;
+static int frames;
+
+/*
+ * Installs seccomp filter returning SECCOMP_RET_TRACE for traced syscalls;
+ * to be called by the child right before exec. Note that once installed,
+ * traced syscalls fail with ENOSYS unless there's a tracer with
+ * PTRACE_O_TRACESECCOMP set.
+ */
+int iostat_install(void)
+{
+	struct sock_filter filter[4 + 2 * sizeof(traced) / sizeof(*traced) + 1];
+	struct sock_fprog prog;
+	int i, n = 0;
+
+	filter[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch));
+	filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0);
+	filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+	filter[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr));
+	for (i = 0; i < sizeof(traced) / sizeof(*traced); i++) {
+		filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, traced[i], 0, 1);
+		filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE);
+	}
+	filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+
+	prog.len = n;
+	prog.filter = filter;
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0)) {
+		return -1;
+	}
+	return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* copies (possibly truncated) string/buffer at 'addr' of 'tid' */
+static int peek(pid_t tid, unsigned long addr, char *buf, size_t size)
+{
+	struct iovec local = { buf, size - 1 };
+	struct iovec remote = { (void *)addr, size - 1 };
+	ssize_t n;
+
+	n = process_vm_readv(tid, &local, 1, &remote, 1, 0);
+	if (n < 0) {
+		n = 0;
+	}
+	buf[n] = '\0';
+	return n;
+}
+
+static int path_flags(pid_t tid, unsigned long addr)
+{
+	char path[256];
+	int flags = 0;
+
+	peek(tid, addr, path, sizeof(path));
+	if (!strncmp(path, "work/", 5) || strstr(path, "/work/")) {
+		flags |= FD_WORK;
+	}
+	if (strstr(path, "/logfile_")) {
+		flags |= FD_LOG;
+	}
+	return flags;
+}
+
+static int fd_flags(long fd)
+{
+	if (fd < 0 || fd >= IOSTAT_MAX_FD)
+		return 0;
+	return fds[fd];
+}
+
+static void burst_report(void)
+{
+	double ms = burst.write_ms + burst.fsync_ms + burst.rename_ms;
+
+	checkpoints++;
+	llog("thekraken: iostat: checkpoint %d: %llu bytes, write %.1f ms, fsync %.1f ms, rename %.1f ms, total %.1f ms\n", checkpoints, burst.bytes, burst.write_ms, burst.fsync_ms, burst.rename_ms, ms);
+	total.write_ms += burst.write_ms;
+	total.fsync_ms += burst.fsync_ms;
+	total.rename_ms += burst.rename_ms;
+	total.bytes += burst.bytes;
+	total.ops += burst.ops;
+	memset(&burst, 0, sizeof(burst));
+}
+
+static void frame_mark(double t)
+{
+	if (burst.ops && t - burst_last > IOSTAT_BURST_GAP) {
+		burst_report();
+	}
+	if (frame_last > 0) {
+		double wall = t - frame_last;
+
+		frames++;
+		frames_wall_ms += wall;
+		frames_io_ms += frame_io_ms;
+		llog("thekraken: iostat: frame %d: %.0f ms, work/ I/O %.1f ms (%.2f%%)\n", frames, wall, frame_io_ms, wall > 0 ? 100.0 * frame_io_ms / wall : 0.0);
+	}
+	frame_last = t;
+	frame_io_ms = 0;
+}
+
+static struct pending *pending_find(pid_t tid)
+{
+	int i;
+
+	for (i = 0; i < IOSTAT_MAX_PENDING; i++) {
+		if (pending[i].tid == tid)
+			return &pending[i];
+	}
+	return NULL;
+}
+
+/* to be called at PTRACE_EVENT_SECCOMP stop */
+void iostat_entry(pid_t tid, struct user_regs_struct *regs)
+{
+	struct pending *p = pending_find(tid);
+
+	if (!p) {
+		p = pending_find(0);
+		if (!p)
+			return;
+	}
+	p->tid = tid;
+	p->fd = -1;
+	p->flags = 0;
+	p->frame = 0;
+	switch (regs->orig_rax) {
+		case SYS_open:
+		case SYS_creat:
+			p->kind = KIND_OPEN;
+			p->flags = path_flags(tid, regs->rdi);
+			break;
+		case SYS_openat:
+			p->kind = KIND_OPEN;
+			p->flags = path_flags(tid, regs->rsi);
+			if ((int)regs->rdi != AT_FDCWD && (fd_flags(regs->rdi) & FD_WORK))
+				p->flags |= FD_WORK;
+			break;
+		case SYS_close:
+			p->kind = KIND_CLOSE;
+			p->fd = regs->rdi;
+			break;
+		case SYS_write:
+		case SYS_pwrite64:
+		case SYS_writev:
+		case SYS_pwritev:
+			p->kind = KIND_WRITE;
+			p->fd = regs->rdi;
+			p->flags = fd_flags(p->fd);
+			if (regs->orig_rax == SYS_write && (p->flags & FD_LOG)) {
+				char buf[128];
+
+				peek(tid, regs->rsi, buf, sizeof(buf) < regs->rdx + 1 ? sizeof(buf) : regs->rdx + 1);
+				p->frame = strstr(buf, "Completed ") != NULL;
+			}
+			break;
+		case SYS_fsync:
+		case SYS_fdatasync:
+			p->kind = KIND_FSYNC;
+			p->fd = regs->rdi;
+			p->flags = fd_flags(p->fd);
+			break;
+		case SYS_rename:
+			p->kind = KIND_RENAME;
+			p->flags = path_flags(tid, regs->rdi) | path_flags(tid, regs->rsi);
+			break;
+		case SYS_renameat:
+		case SYS_renameat2:
+			p->kind = KIND_RENAME;
+			p->flags = path_flags(tid, regs->rsi) | path_flags(tid, regs->r10);
+			break;
+		default:
+			p->tid = 0;
+			return;
+	}
+	p->start = now_ms();
+}
+
+int iostat_pending(pid_t tid)
+{
+	return tid != 0 && pending_find(tid) != NULL;
+}
+
+/* to be called at syscall exit stop of a thread for which iostat_pending() is true */
+void iostat_exit(pid_t tid, struct user_regs_struct *regs)
+{
+	struct pending *p = pending_find(tid);
+	long ret = regs->rax;
+	double t = now_ms(), ms;
+
+	if (!p) {
+		return;
+	}
+	p->tid = 0;
+	ms = t - p->start;
+
+	switch (p->kind) {
+		case KIND_OPEN:
+			if (ret >= 0 && ret < IOSTAT_MAX_FD)
+				fds[ret] = p->flags;
+			return;
+		case KIND_CLOSE:
+			if (ret == 0 && p->fd >= 0 && p->fd < IOSTAT_MAX_FD)
+				fds[p->fd] = 0;
+			return;
+	}
+	if (p->frame) {
+		frame_mark(t);
+	}
+	if (!(p->flags & FD_WORK) || (p->flags & FD_LOG)) {
+		return;
+	}
+
+	if (burst.ops && p->start - burst_last > IOSTAT_BURST_GAP) {
+		burst_report();
+	}
+	switch (p->kind) {
+		case KIND_WRITE:
+			burst.write_ms += ms;
+			if (ret > 0)
+				burst.bytes += ret;
+			break;
+		case KIND_FSYNC:
+			burst.fsync_ms += ms;
+			break;
+		case KIND_RENAME:
+			burst.rename_ms += ms;
+			break;
+	}
+	burst.ops++;
+	burst_last = t;
+	frame_io_ms += ms;
+	debug(2) llog("thekraken: iostat: %d: %s fd %d: %.3f ms, returns %ld\n", tid, p->kind == KIND_WRITE ? "write" : p->kind == KIND_FSYNC ? "fsync" : "rename", p->fd, ms, ret);
+}
+
+/* summary; to be called once FahCore is gone */
+void iostat_report(void)
+{
+	double ms;
+
+	if (burst.ops) {
+		burst_report();
+	}
+	ms = total.write_ms + total.fsync_ms + total.rename_ms;
+	llog("thekraken: iostat: %d checkpoint(s), %llu bytes, %.1f ms of work/ I/O (average %.1f ms per checkpoint)\n", checkpoints, total.bytes, ms, checkpoints ? ms / checkpoints : 0.0);
+	if (frames) {
+		llog("thekraken: iostat: %.2f%% of wall time of %d frame(s) spent in work/ I/O\n", frames_wall_ms > 0 ? 100.0 * frames_io_ms / frames_wall_ms : 0.0, frames);
+	}
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Keeping device interrupts and unbound kernel workqueues off the cpus
+ * FahCore ranks run on. Original settings are saved the first time they
+ * get changed and put back by irqaff_restore(). IRQ and workqueue masks
+ * are global, so only one wrapper at a time gets to change them (lock on
+ * IRQAFF_LOCK, released at restore or exit). All paths go through
+ * topo_path() so a fake /proc and /sys can stand in for the real ones.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "irqaff.h"
+#include "topology.h"
+
+#define IRQ_DIR "/proc/irq"
+#define WQ_DIR "/sys/devices/virtual/workqueue"
+#define IRQAFF_LOCK "/run/thekraken-isolate.lock"
+#define SAVED_MAX 4096
+
+struct saved {
+	char *path;
+	char *val;
+};
+
+static struct saved *saved;
+static int nsaved;
+static pid_t owner; /* forked children leave our settings alone */
+static int lock_fd = -1;
+
+/* takes IRQAFF_LOCK; -1 with errno EBUSY if another wrapper holds it */
+static int lock(void)
+{
+	struct flock fl = { .l_type = F_WRLCK, .l_whence = SEEK_SET };
+	char fn[PATH_MAX];
+
+	if (lock_fd != -1) {
+		return 0;
+	}
+	lock_fd = open(topo_path(fn, sizeof(fn), IRQAFF_LOCK), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (lock_fd == -1) {
+		/* no /run (snapshot); nobody to coordinate with */
+		return 0;
+	}
+	if (fcntl(lock_fd, F_SETLK, &fl)) {
+		close(lock_fd);
+		lock_fd = -1;
+		errno = EBUSY;
+		return -1;
+	}
+	return 0;
+}
+
+static int read_val(const char *fn, char *buf, int size)
+{
+	int fd, n;
+
+	fd = open(fn, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	n = read(fd, buf, size - 1);
+	close(fd);
+	if (n <= 0)
+		return -1;
+	buf[n] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
+}
+
+static int write_val(const char *fn, const char *val)
+{
+	int fd, rv;
+
+	fd = open(fn, O_WRONLY | O_TRUNC | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	rv = write(fd, val, strlen(val)) == strlen(val) ? 0 : -1;
+	if (close(fd))
+		rv = -1;
+	return rv;
+}
+
+/* saves current value of 'fn' (unless saved already) and writes 'val' */
+static int save_write(const char *fn, const char *val)
+{
+	char old[1024];
+	int i;
+
+	for (i = 0; i < nsaved; i++) {
+		if (!strcmp(saved[i].path, fn))
+			break;
+	}
+	if (i == nsaved) {
+		if (nsaved == SAVED_MAX || read_val(fn, old, sizeof(old)))
+			return -1;
+		if (!saved && !(saved = malloc(SAVED_MAX * sizeof(*saved))))
+			return -1;
+		saved[nsaved].path = strdup(fn);
+		saved[nsaved].val = strdup(old);
+		nsaved++;
+	}
+	return write_val(fn, val);
+}
+
+/* formats 'set' as kernel cpumask: 32-bit hex words, most significant first */
+static void format_mask(const cpu_set_t *set, size_t size, char *buf, size_t bufsize)
+{
+	int words = (topo_nr_cpus() + 31) / 32;
+	int w, b, n = 0;
+
+	buf[0] = '\0';
+	for (w = words - 1; w >= 0 && n < bufsize; w--) {
+		unsigned int v = 0;
+
+		for (b = 0; b < 32; b++) {
+			if (CPU_ISSET_S(w * 32 + b, size, set))
+				v |= 1U << b;
+		}
+		n += snprintf(buf + n, bufsize - n, "%08x%s", v, w ? "," : "");
+	}
+}
+
+/*
+ * Points IRQs and unbound workqueues at 'house' cpus. Returns number of
+ * IRQs moved; 'refused' gets number of IRQs that can't be moved (per-cpu,
+ * kernel managed), 'wqs' number of workqueue masks set. Returns -1 (errno
+ * EBUSY) if another wrapper has them changed.
+ */
+int irqaff_isolate(const cpu_set_t *house, size_t size, int *refused, int *wqs)
+{
+	char fn[PATH_MAX];
+	char list[1024], mask[1024];
+	DIR *d;
+	struct dirent *de;
+	int moved = 0;
+
+	*refused = *wqs = 0;
+	if (lock()) {
+		return -1;
+	}
+	owner = getpid();
+	topo_format_cpulist(house, size, list, sizeof(list));
+	format_mask(house, size, mask, sizeof(mask));
+
+	d = opendir(topo_path(fn, sizeof(fn), IRQ_DIR));
+	if (d) {
+		while ((de = readdir(d))) {
+			if (!isdigit(de->d_name[0]))
+				continue;
+			topo_path(fn, sizeof(fn), IRQ_DIR "/%s/smp_affinity_list", de->d_name);
+			if (save_write(fn, list))
+				(*refused)++;
+			else
+				moved++;
+		}
+		closedir(d);
+	}
+
+	/* global mask of unbound workqueues, then those exposed individually */
+	if (!save_write(topo_path(fn, sizeof(fn), WQ_DIR "/cpumask"), mask))
+		(*wqs)++;
+	d = opendir(topo_path(fn, sizeof(fn), WQ_DIR));
+	if (d) {
+		while ((de = readdir(d))) {
+			if (de->d_name[0] == '.')
+				continue;
+			topo_path(fn, sizeof(fn), WQ_DIR "/%s/cpumask", de->d_name);
+			if (access(fn, W_OK))
+				continue;
+			if (!save_write(fn, mask))
+				(*wqs)++;
+		}
+		closedir(d);
+	}
+	return moved;
+}
+
+/* puts back everything irqaff_isolate() changed; returns number of settings restored */
+int irqaff_restore(void)
+{
+	int i, n = 0;
+
+	if (getpid() != owner) {
+		return 0;
+	}
+	for (i = 0; i < nsaved; i++) {
+		if (!write_val(saved[i].path, saved[i].val))
+			n++;
+		free(saved[i].path);
+		free(saved[i].val);
+	}
+	nsaved = 0;
+	if (lock_fd != -1) {
+		close(lock_fd);
+		lock_fd = -1;
+	}
+	return n;
+}
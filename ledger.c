@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Per-project performance ledger. Every WU leaves a line in LEDGER_FN
+ * (in the client directory):
+ *
+ *   <time> project <P> core <name> np <N> placement <policy> on <ms> off <ms> dlb <s> frames <n> tpf <s> <s>,<s>,...
+ *
+ * 'dlb' is time from first step to DLB engagement (-1 if not seen), 'tpf'
+ * average time per frame followed by time of every frame. When a project
+ * shows up again, settings with the lowest average TPF recorded for it
+ * (same core and np) are used; now and then a neighbour of these is tried
+ * instead so that the ledger doesn't get stuck with the first settings
+ * that happened to work.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ledger.h"
+#include "placement.h"
+#include "llog.h"
+
+#define LEDGER_LINE 4096
+#define LEDGER_MAX_CONF 64
+#define LEDGER_MAX_FRAMES 512
+#define LOG_LINE 512
+
+struct entry {
+	struct ledger_conf c;
+	double tpf;	/* sum of per-WU averages */
+	int wus;
+};
+
+static FILE *logfile_open(const char *slot)
+{
+	char fn[32];
+
+	if (!slot || !slot[0]) {
+		return NULL;
+	}
+	snprintf(fn, sizeof(fn), "work/logfile_%s.txt", slot);
+	return fopen(fn, "r");
+}
+
+/* project of the WU being crunched as of FahCore's logfile; -1 if unknown */
+int ledger_project(const char *slot)
+{
+	char line[LOG_LINE];
+	FILE *f = logfile_open(slot);
+	int project = -1;
+	char *p;
+
+	if (!f) {
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if ((p = strstr(line, "Project: ")))
+			sscanf(p, "Project: %d", &project);
+	}
+	fclose(f);
+	return project;
+}
+
+/* times (s) of frames completed since the WU was (re)started */
+static int frame_times(const char *slot, int *tpf, int max)
+{
+	char line[LOG_LINE];
+	FILE *f = logfile_open(slot);
+	int n = 0, prev = -1;
+
+	if (!f) {
+		return 0;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		int h, m, s, t;
+
+		if (strstr(line, "Project: ")) {
+			n = 0;
+			prev = -1;
+			continue;
+		}
+		if (!strstr(line, "Completed ") || !strstr(line, "out of") || sscanf(line, "[%d:%d:%d]", &h, &m, &s) != 3)
+			continue;
+		t = h * 3600 + m * 60 + s;
+		if (prev >= 0 && n < max) {
+			tpf[n++] = t >= prev ? t - prev : t - prev + 86400;
+		}
+		prev = t;
+	}
+	fclose(f);
+	return n;
+}
+
+static void neighbour(struct ledger_conf *c)
+{
+	switch (rand() % 3) {
+		case 0:
+			c->placement = (c->placement + 1 + rand() % (PLACE_MAX - 1)) % PLACE_MAX;
+			break;
+		case 1:
+			c->onperiod = rand() % 2 ? c->onperiod * 3 / 4 : c->onperiod * 5 / 4;
+			break;
+		case 2:
+			c->offperiod = rand() % 2 ? c->offperiod / 2 : c->offperiod * 2;
+			break;
+	}
+	if (c->onperiod < 100)
+		c->onperiod = 100;
+	if (c->offperiod < 10)
+		c->offperiod = 10;
+}
+
+/*
+ * Replaces 'c' with best settings known for 'project' (or, 'explore'
+ * percent of the time, with a neighbour of these). Returns 0 if the
+ * ledger knows nothing about the project and 'c' was left alone.
+ */
+int ledger_choose(int project, const char *core, int np, int explore, struct ledger_conf *c)
+{
+	struct entry e[LEDGER_MAX_CONF];
+	char line[LEDGER_LINE];
+	FILE *f;
+	int ne = 0, best = -1, i;
+
+	f = fopen(LEDGER_FN, "r");
+	if (f) {
+		while (fgets(line, sizeof(line), f)) {
+			char lcore[32], lplace[16];
+			struct ledger_conf lc;
+			int lproject, lnp, ldlb, lframes;
+			long t;
+			double ltpf;
+
+			if (sscanf(line, "%ld project %d core %31s np %d placement %15s on %d off %d dlb %d frames %d tpf %lf", &t, &lproject, lcore, &lnp, lplace, &lc.onperiod, &lc.offperiod, &ldlb, &lframes, &ltpf) != 10)
+				continue;
+			lc.placement = place_parse(lplace);
+			if (lproject != project || strcmp(lcore, core) || lnp != np || lframes == 0 || lc.placement < 0)
+				continue;
+			for (i = 0; i < ne; i++) {
+				if (!memcmp(&e[i].c, &lc, sizeof(lc)))
+					break;
+			}
+			if (i == ne) {
+				if (ne == LEDGER_MAX_CONF)
+					continue;
+				e[ne].c = lc;
+				e[ne].tpf = 0;
+				e[ne++].wus = 0;
+			}
+			e[i].tpf += ltpf;
+			e[i].wus++;
+		}
+		fclose(f);
+	}
+	for (i = 0; i < ne; i++) {
+		if (best < 0 || e[i].tpf / e[i].wus < e[best].tpf / e[best].wus)
+			best = i;
+	}
+	if (best < 0) {
+		llog("thekraken: ledger: project %d not seen before; using configured settings\n", project);
+		return 0;
+	}
+	*c = e[best].c;
+	llog("thekraken: ledger: project %d: best known settings: %s placement, synthload on %dms off %dms (average TPF %.1fs over %d WU(s))\n", project, place_name(c->placement), c->onperiod, c->offperiod, e[best].tpf / e[best].wus, e[best].wus);
+	srand(time(NULL) ^ getpid());
+	if (rand() % 100 < explore) {
+		neighbour(c);
+		llog("thekraken: ledger: project %d: exploring %s placement, synthload on %dms off %dms\n", project, place_name(c->placement), c->onperiod, c->offperiod);
+	}
+	return 1;
+}
+
+/* appends record of the WU which just finished (or got interrupted) */
+void ledger_record(int project, const char *core, int np, const struct ledger_conf *c, int dlb, const char *slot)
+{
+	int tpf[LEDGER_MAX_FRAMES];
+	int n, i;
+	double sum = 0;
+	FILE *f;
+
+	n = frame_times(slot, tpf, LEDGER_MAX_FRAMES);
+	if (project < 0 || n == 0) {
+		llog("thekraken: ledger: nothing to record (project %d, %d frame(s))\n", project, n);
+		return;
+	}
+	f = fopen(LEDGER_FN, "a");
+	if (!f) {
+		llog("thekraken: ledger: cannot open %s\n", LEDGER_FN);
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		sum += tpf[i];
+	}
+	fprintf(f, "%ld project %d core %s np %d placement %s on %d off %d dlb %d frames %d tpf %.1f ", (long)time(NULL), project, core, np, place_name(c->placement), c->onperiod, c->offperiod, dlb, n, sum / n);
+	for (i = 0; i < n; i++) {
+		fprintf(f, i ? ",%d" : "%d", tpf[i]);
+	}
+	fprintf(f, "\n");
+	fclose(f);
+	llog("thekraken: ledger: project %d: %d frame(s), average TPF %.1fs, recorded\n", project, n, sum / n);
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __LEDGER_H
+#define __LEDGER_H
+
+#define LEDGER_FN "thekraken.ledger"
+
+/* settings the autotuner picks per project */
+struct ledger_conf {
+	int placement;	/* PLACE_* */
+	int onperiod;	/* synthload, ms */
+	int offperiod;
+};
+
+int ledger_project(const char *slot);
+int ledger_choose(int project, const char *core, int np, int explore, struct ledger_conf *c);
+void ledger_record(int project, const char *core, int np, const struct ledger_conf *c, int dlb, const char *slot);
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <string.h>
+
+#include "logscan.h"
+#include "llog.h"
+
+void logscan_init(struct logscan *ls, const char *name)
+{
+	ls->name = name;
+	ls->pos = 0;
+	ls->buf[0] = '\0';
+	ls->steps = 0;
+}
+
+static int scan_line(const char *line)
+{
+	int events = 0;
+
+	if (strstr(line, "Completed ") != NULL && strstr(line, "out of") != NULL) {
+		events |= LOGSCAN_FIRST_STEP;
+	}
+	if (strstr(line, "Turning on dynamic load balancing") != NULL) {
+		events |= LOGSCAN_DLB;
+	}
+	return events;
+}
+
+/*
+ * Feeds 'len' bytes of FahCore's logfile or stderr output to 'ls' and
+ * returns LOGSCAN_* events found in lines completed so far. Every step
+ * line is counted in ls->steps, as one feed may well hold several.
+ */
+int logscan_feed(struct logscan *ls, const char *data, int len)
+{
+	int events = 0;
+	int i, ev;
+
+	for (i = 0; i < len; i++) {
+		if (data[i] == '\n') {
+			ls->buf[ls->pos] = '\0';
+			ev = scan_line(ls->buf);
+			ls->steps += !!(ev & LOGSCAN_FIRST_STEP);
+			events |= ev;
+			ls->pos = 0;
+			continue;
+		}
+		if (ls->pos == sizeof(ls->buf) - 1) {
+			ls->buf[ls->pos] = '\0';
+			ev = scan_line(ls->buf);
+			ls->steps += !!(ev & LOGSCAN_FIRST_STEP);
+			events |= ev;
+			debug(1) llog("thekraken: %s buffer overflow! Clearing the buffer.\n", ls->name);
+			ls->pos = 0;
+		}
+		ls->buf[ls->pos++] = data[i];
+	}
+	return events;
+}
+
+/*
+ * Tells whether 'path' opened by FahCore is its logfile (logfile_XX.txt);
+ * if so, copies XX to 'slot' (3 bytes) when present.
+ */
+int logscan_logfile(const char *path, char *slot)
+{
+	const char *tmp = strstr(path, "/logfile_");
+
+	if (!tmp) {
+		return 0;
+	}
+	if (tmp[9] != '\0' && tmp[10] != '\0') {
+		slot[0] = tmp[9];
+		slot[1] = tmp[10];
+		slot[2] = '\0';
+	}
+	return 1;
+}
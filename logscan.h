@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __LOGSCAN_H
+#define __LOGSCAN_H
+
+#define LOGSCAN_BUF_SIZE 128
+
+#define LOGSCAN_FIRST_STEP 1	/* "Completed ... out of" line */
+#define LOGSCAN_DLB 2		/* DLB has engaged */
+
+struct logscan {
+	const char *name;	/* for diagnostics */
+	char buf[LOGSCAN_BUF_SIZE];
+	int pos;
+	int steps;		/* "Completed ... out of" lines seen so far */
+};
+
+void logscan_init(struct logscan *ls, const char *name);
+int logscan_feed(struct logscan *ls, const char *data, int len);
+int logscan_logfile(const char *path, char *slot);
+
+#endif
@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * NUMA locality benchmark mimicking GROMACS domain decomposition. It is
+ * meant to be wrapped and run in place of FahCore (see 'make bench-numa')
+ * so that its threads get bound, and their memory placed, by The Kraken
+ * exactly as real FahCore's are.
+ *
+ * Thread layout follows FahCore: main thread creates master thread which
+ * creates two helper threads and np - 1 ranks; master is rank 0. Every
+ * rank owns a block of the 3D domain grid and first-touches its arrays.
+ * Each step a rank copies boundary planes of its 6 neighbours straight
+ * from their arrays (halo exchange through shared memory), relaxes its
+ * own block and waits on a barrier. Step progress goes to
+ * work/logfile_01.txt the way FahCore reports it.
+ *
+ * Usage: FahCore_xx -np N [-steps S] [-size CELLS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define DEFAULT_STEPS 200
+#define DEFAULT_SIZE 48		/* cells along block edge */
+#define FRAMES 10		/* progress lines written to the logfile */
+#define MAX_RANKS 1024
+
+struct rank {
+	int id;
+	int x, y, z;		/* position in the grid */
+	int nb[6];		/* neighbours: -x, +x, -y, +y, -z, +z */
+	double *a, *b;		/* (size + 2)^3 cells, including ghost layers */
+	int node;		/* where the rank runs */
+	double local, remote;	/* bytes touched per step, by page location */
+};
+
+static int np = 1, steps = DEFAULT_STEPS, size = DEFAULT_SIZE;
+static int px, py, pz;
+static struct rank *ranks;
+static pthread_barrier_t barrier;
+static volatile int done;
+static int logfd = -1;
+static double start_ms, step_ms;
+
+#define IDX(i, j, k) (((i) * (size + 2) + (j)) * (size + 2) + (k))
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* px * py * pz = np, as close to a cube as possible */
+static void decompose(void)
+{
+	int best = -1, x, y;
+
+	for (x = 1; x <= np; x++) {
+		if (np % x)
+			continue;
+		for (y = 1; y <= np / x; y++) {
+			int z, surface;
+
+			if ((np / x) % y)
+				continue;
+			z = np / x / y;
+			surface = x * y + y * z + x * z;
+			if (best < 0 || surface < best) {
+				best = surface;
+				px = x;
+				py = y;
+				pz = z;
+			}
+		}
+	}
+}
+
+static int rank_at(int x, int y, int z)
+{
+	x = (x + px) % px;
+	y = (y + py) % py;
+	z = (z + pz) % pz;
+	return (x * py + y) * pz + z;
+}
+
+static int page_node(void *p)
+{
+	void *page = (void *)((unsigned long)p & ~(sysconf(_SC_PAGESIZE) - 1));
+	int status = -1;
+
+	if (syscall(SYS_move_pages, 0, 1, &page, NULL, &status, 0) || status < 0) {
+		return -1;
+	}
+	return status;
+}
+
+/* splits bytes a rank touches per step into local and remote by page location */
+static void locality(struct rank *r)
+{
+	long cells = (long)(size + 2) * (size + 2) * (size + 2);
+	long pagesz = sysconf(_SC_PAGESIZE);
+	double plane = (double)size * size * sizeof(double);
+	char *p;
+	int i;
+
+	r->local = r->remote = 0;
+	for (p = (char *)r->a; p < (char *)(r->a + cells); p += pagesz) {
+		if (page_node(p) == r->node)
+			r->local += 2 * pagesz;	/* read a, write b */
+		else
+			r->remote += 2 * pagesz;
+	}
+	for (i = 0; i < 6; i++) {
+		if (page_node(ranks[r->nb[i]].a + IDX(size / 2, size / 2, size / 2)) == r->node)
+			r->local += plane;
+		else
+			r->remote += plane;
+	}
+}
+
+static void halo(struct rank *r)
+{
+	double *w, *e, *s, *n, *d, *u;
+	int i, j;
+
+	w = ranks[r->nb[0]].a;
+	e = ranks[r->nb[1]].a;
+	s = ranks[r->nb[2]].a;
+	n = ranks[r->nb[3]].a;
+	d = ranks[r->nb[4]].a;
+	u = ranks[r->nb[5]].a;
+	for (i = 1; i <= size; i++) {
+		for (j = 1; j <= size; j++) {
+			r->a[IDX(0, i, j)] = w[IDX(size, i, j)];
+			r->a[IDX(size + 1, i, j)] = e[IDX(1, i, j)];
+			r->a[IDX(i, 0, j)] = s[IDX(i, size, j)];
+			r->a[IDX(i, size + 1, j)] = n[IDX(i, 1, j)];
+			r->a[IDX(i, j, 0)] = d[IDX(i, j, size)];
+			r->a[IDX(i, j, size + 1)] = u[IDX(i, j, 1)];
+		}
+	}
+}
+
+static void relax(struct rank *r)
+{
+	double *t;
+	int i, j, k;
+
+	for (i = 1; i <= size; i++) {
+		for (j = 1; j <= size; j++) {
+			for (k = 1; k <= size; k++) {
+				r->b[IDX(i, j, k)] = (r->a[IDX(i - 1, j, k)] + r->a[IDX(i + 1, j, k)] +
+					r->a[IDX(i, j - 1, k)] + r->a[IDX(i, j + 1, k)] +
+					r->a[IDX(i, j, k - 1)] + r->a[IDX(i, j, k + 1)]) / 6.0;
+			}
+		}
+	}
+	t = r->a;
+	r->a = r->b;
+	r->b = t;
+}
+
+static void *rank_main(void *arg)
+{
+	struct rank *r = arg;
+	long cells = (long)(size + 2) * (size + 2) * (size + 2);
+	unsigned int cpu, node;
+	double t0 = 0;
+	int s, i;
+
+	/* first touch from the (already bound) rank itself */
+	r->a = malloc(cells * sizeof(double));
+	r->b = malloc(cells * sizeof(double));
+	if (!r->a || !r->b) {
+		perror("numabench: malloc");
+		exit(1);
+	}
+	for (i = 0; i < cells; i++) {
+		r->a[i] = r->id + i % 7;
+		r->b[i] = 0;
+	}
+	pthread_barrier_wait(&barrier);
+
+	for (s = 0; s <= steps; s++) {
+		if (s == 1 && r->id == 0) {
+			t0 = now_ms();	/* step 0 is a warm-up */
+		}
+		if (r->id == 0 && s % (steps / FRAMES ? steps / FRAMES : 1) == 0) {
+			int t = (now_ms() - start_ms) / 1000;
+
+			dprintf(logfd, "[%02d:%02d:%02d] Completed %d out of %d steps  (%d%%)\n", t / 3600, t / 60 % 60, t % 60, s, steps, s * 100 / steps);
+			if (s > 0 && s == steps / FRAMES) {
+				/* FahCore says so on stderr a few steps in */
+				fprintf(stderr, "\nTurning on dynamic load balancing\n\n");
+			}
+		}
+		halo(r);
+		pthread_barrier_wait(&barrier);
+		relax(r);
+		pthread_barrier_wait(&barrier);
+	}
+	if (r->id == 0) {
+		step_ms = (now_ms() - t0) / steps;
+	}
+
+	syscall(SYS_getcpu, &cpu, &node, NULL);
+	r->node = node;
+	pthread_barrier_wait(&barrier);
+	locality(r);
+	return NULL;
+}
+
+static void *helper_main(void *arg)
+{
+	while (!done) {
+		usleep(10000);
+	}
+	return NULL;
+}
+
+static void *master_main(void *arg)
+{
+	pthread_t helpers[2], *threads;
+	int i;
+
+	threads = malloc(np * sizeof(*threads));
+	for (i = 0; i < 2; i++) {
+		pthread_create(&helpers[i], NULL, helper_main, NULL);
+	}
+	for (i = 1; i < np; i++) {
+		pthread_create(&threads[i], NULL, rank_main, &ranks[i]);
+	}
+	rank_main(&ranks[0]);
+	for (i = 1; i < np; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	done = 1;
+	for (i = 0; i < 2; i++) {
+		pthread_join(helpers[i], NULL);
+	}
+	free(threads);
+	return NULL;
+}
+
+int main(int ac, char **av)
+{
+	pthread_t master;
+	double local = 0, remote = 0;
+	const char *tag = getenv("NUMABENCH_TAG");
+	int i;
+
+	for (i = 1; i < ac - 1; i++) {
+		if (!strcmp(av[i], "-np"))
+			np = atoi(av[i + 1]);
+		else if (!strcmp(av[i], "-steps"))
+			steps = atoi(av[i + 1]);
+		else if (!strcmp(av[i], "-size"))
+			size = atoi(av[i + 1]);
+	}
+	if (np < 1 || np > MAX_RANKS || steps < 1 || size < 2) {
+		fprintf(stderr, "numabench: invalid parameters\n");
+		return 1;
+	}
+
+	decompose();
+	ranks = calloc(np, sizeof(*ranks));
+	for (i = 0; i < np; i++) {
+		struct rank *r = &ranks[i];
+
+		r->id = i;
+		r->x = i / (py * pz);
+		r->y = i / pz % py;
+		r->z = i % pz;
+		r->nb[0] = rank_at(r->x - 1, r->y, r->z);
+		r->nb[1] = rank_at(r->x + 1, r->y, r->z);
+		r->nb[2] = rank_at(r->x, r->y - 1, r->z);
+		r->nb[3] = rank_at(r->x, r->y + 1, r->z);
+		r->nb[4] = rank_at(r->x, r->y, r->z - 1);
+		r->nb[5] = rank_at(r->x, r->y, r->z + 1);
+	}
+	pthread_barrier_init(&barrier, NULL, np);
+
+	/* The Kraken looks for open(2) of the logfile */
+	start_ms = now_ms();
+	mkdir("work", 0755);
+	logfd = syscall(SYS_open, "work/logfile_01.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	dprintf(logfd, "[00:00:00] Project: 0 (Run 0, Clone 0, Gen 0)\n");
+
+	pthread_create(&master, NULL, master_main, NULL);
+	pthread_join(master, NULL);
+
+	for (i = 0; i < np; i++) {
+		local += ranks[i].local;
+		remote += ranks[i].remote;
+	}
+	printf("numabench: %s np %d (grid %dx%dx%d, %d^3 cells per rank): step %.3f ms, %.1f Mcells/s, remote access %.1f%%\n", tag ? tag : "-", np, px, py, pz, size, step_ms, step_ms > 0 ? (double)np * size * size * size / step_ms / 1000.0 : 0.0, local + remote > 0 ? 100.0 * remote / (local + remote) : 0.0);
+	return 0;
+}
@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/mempolicy.h>
+
+#include "topology.h"
+#include "numamig.h"
+#include "llog.h"
+
+#define SCAN_CHUNK 512 /* pages queried/moved per move_pages() call */
+
+/* a VMA is considered private to its home node if that node holds at least 3/4 of its pages */
+#define PRIVATE_NUM 3
+#define PRIVATE_DEN 4
+
+struct vma {
+	unsigned long start, end;
+	long pages[TOPO_MAX_NODES];
+	long total;
+	int home;
+	long misplaced;
+};
+
+static pid_t target;
+static unsigned int _rate;
+static long pagesize;
+
+static int threads[TOPO_MAX_NODES]; /* number of FahCore threads currently running on each node */
+
+static long move_pages(pid_t pid, unsigned long count, void **pages, const int *nodes, int *status, int flags)
+{
+	return syscall(SYS_move_pages, pid, count, pages, nodes, status, flags);
+}
+
+/*
+ * Establishes which nodes FahCore threads run on and, if the kernel
+ * keeps NUMA fault statistics (NUMA balancing), how much of each thread's
+ * memory traffic is remote. Returns average per-thread locality in
+ * permille or -1 if no fault statistics are available.
+ */
+static int scan_threads(void)
+{
+	DIR *d;
+	struct dirent *de;
+	char fn[PATH_MAX];
+	long locality = 0;
+	int nthreads = 0;
+
+	memset(threads, 0, sizeof(threads));
+
+	topo_path(fn, sizeof(fn), "/proc/%d/task", target);
+	d = opendir(fn);
+	if (!d) {
+		return -1;
+	}
+	while ((de = readdir(d))) {
+		char buf[512];
+		FILE *fp;
+		char *s;
+		int i, cpu = -1, node;
+		long local = 0, total = 0;
+
+		if (!isdigit(de->d_name[0]))
+			continue;
+		topo_path(fn, sizeof(fn), "/proc/%d/task/%s/stat", target, de->d_name);
+		fp = fopen(fn, "r");
+		if (!fp)
+			continue;
+		s = NULL;
+		if (fgets(buf, sizeof(buf), fp))
+			s = strrchr(buf, ')');
+		fclose(fp);
+		if (!s)
+			continue;
+		/* 'processor' is field 39; field 3 follows the closing parenthesis */
+		for (i = 2; s && i < 39; i++) {
+			s = strchr(s + 1, ' ');
+		}
+		if (!s)
+			continue;
+		cpu = atoi(s + 1);
+		node = topo_cpu_node(cpu);
+		threads[node]++;
+
+		topo_path(fn, sizeof(fn), "/proc/%d/task/%s/sched", target, de->d_name);
+		fp = fopen(fn, "r");
+		if (!fp)
+			continue;
+		while (fgets(buf, sizeof(buf), fp)) {
+			int n;
+			unsigned long tp, ts;
+
+			if (sscanf(buf, "numa_faults node=%d task_private=%lu task_shared=%lu", &n, &tp, &ts) != 3)
+				continue;
+			total += tp + ts;
+			if (n == node)
+				local += tp + ts;
+		}
+		fclose(fp);
+		if (total) {
+			debug(3) llog("thekraken: numamig: thread %s on node %d: %ld%% of NUMA faults remote\n", de->d_name, node, (total - local) * 100 / total);
+			locality += local * 1000 / total;
+			nthreads++;
+		}
+	}
+	closedir(d);
+
+	return nthreads ? locality / nthreads : -1;
+}
+
+/*
+ * Reads per-node page counts of anonymous mappings from numa_maps and
+ * assigns every mapping a home node (thread-hosting node holding most of
+ * its pages). Returns number of mappings read into *vmas.
+ */
+static int scan_vmas(struct vma **vmas, long *local, long *total)
+{
+	FILE *fp;
+	char fn[PATH_MAX];
+	char buf[1024];
+	int n = 0, size = 0;
+	int busiest = 0, i;
+
+	*vmas = NULL;
+	*local = *total = 0;
+
+	for (i = 0; i < TOPO_MAX_NODES; i++) {
+		if (threads[i] > threads[busiest])
+			busiest = i;
+	}
+
+	topo_path(fn, sizeof(fn), "/proc/%d/maps", target);
+	fp = fopen(fn, "r");
+	if (!fp) {
+		return 0;
+	}
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (n == size) {
+			size = size ? size * 2 : 64;
+			*vmas = realloc(*vmas, size * sizeof(**vmas));
+		}
+		memset(&(*vmas)[n], 0, sizeof(**vmas));
+		if (sscanf(buf, "%lx-%lx", &(*vmas)[n].start, &(*vmas)[n].end) == 2)
+			n++;
+	}
+	fclose(fp);
+
+	topo_path(fn, sizeof(fn), "/proc/%d/numa_maps", target);
+	fp = fopen(fn, "r");
+	if (!fp) {
+		return 0;
+	}
+	i = 0;
+	while (fgets(buf, sizeof(buf), fp)) {
+		unsigned long start;
+		struct vma *v;
+		char *s;
+		int node;
+
+		if (sscanf(buf, "%lx", &start) != 1)
+			continue;
+		while (i < n && (*vmas)[i].start < start)
+			i++;
+		if (i == n || (*vmas)[i].start != start)
+			continue;
+		v = &(*vmas)[i];
+		if (!strstr(buf, " anon=") || strstr(buf, " file=") || strstr(buf, " huge"))
+			continue;
+		if ((s = strstr(buf, "kernelpagesize_kB=")) && atol(s + 18) * 1024 != pagesize)
+			continue;
+		for (s = strstr(buf, " N"); s; s = strstr(s + 1, " N")) {
+			if (sscanf(s, " N%d=", &node) != 1 || node < 0 || node >= TOPO_MAX_NODES)
+				continue;
+			v->pages[node] = atol(strchr(s, '=') + 1);
+			v->total += v->pages[node];
+		}
+		if (!v->total)
+			continue;
+
+		v->home = busiest;
+		for (node = 0; node < TOPO_MAX_NODES; node++) {
+			if (threads[node] && v->pages[node] > v->pages[v->home])
+				v->home = node;
+		}
+		if (v->pages[v->home] * PRIVATE_DEN >= v->total * PRIVATE_NUM) {
+			/* private-ish mapping; everything off its home node is misplaced */
+			v->misplaced = v->total - v->pages[v->home];
+			*local += v->pages[v->home];
+		} else {
+			/* shared mapping; only pages on nodes without FahCore threads are misplaced */
+			for (node = 0; node < TOPO_MAX_NODES; node++) {
+				if (threads[node])
+					*local += v->pages[node];
+				else
+					v->misplaced += v->pages[node];
+			}
+		}
+		*total += v->total;
+	}
+	fclose(fp);
+
+	return n;
+}
+
+/*
+ * Moves misplaced pages of 'v' to its home node, spending no more than
+ * '*budget' page moves. Sleeps between batches so that no more than
+ * '_rate' pages per second get migrated.
+ */
+static long migrate_vma(struct vma *v, long *budget)
+{
+	void *pages[SCAN_CHUNK];
+	void *move[SCAN_CHUNK];
+	int nodes[SCAN_CHUNK];
+	int status[SCAN_CHUNK];
+	unsigned long addr = v->start;
+	long moved = 0;
+	long left = v->misplaced;
+
+	while (addr < v->end && left > 0 && *budget > 0) {
+		int i, n = 0, m = 0;
+
+		for (; addr < v->end && n < SCAN_CHUNK; addr += pagesize) {
+			pages[n++] = (void *)addr;
+		}
+		if (move_pages(target, n, pages, NULL, status, 0)) {
+			break;
+		}
+		for (i = 0; i < n && m < *budget; i++) {
+			if (status[i] < 0 || status[i] == v->home)
+				continue;
+			if (status[i] < TOPO_MAX_NODES && threads[status[i]] && v->pages[v->home] * PRIVATE_DEN < v->total * PRIVATE_NUM)
+				continue; /* shared mapping; page is local to some other thread */
+			move[m] = pages[i];
+			nodes[m] = v->home;
+			m++;
+		}
+		if (m == 0)
+			continue;
+		if (move_pages(target, m, move, nodes, status, MPOL_MF_MOVE) < 0) {
+			debug(2) llog("thekraken: numamig: move_pages: %s\n", strerror(errno));
+			break;
+		}
+		for (i = 0; i < m; i++) {
+			if (status[i] == v->home)
+				moved++;
+		}
+		left -= m;
+		*budget -= m;
+		usleep((useconds_t)((long long)m * 1000000 / _rate));
+	}
+	return moved;
+}
+
+static void numamig_pass(unsigned int pass, unsigned int interval)
+{
+	struct vma *vmas;
+	long local, total, local_after, total_after;
+	long budget = (long)_rate * interval;
+	long moved = 0;
+	int thread_locality;
+	int n, i;
+
+	thread_locality = scan_threads();
+	n = scan_vmas(&vmas, &local, &total);
+	if (total == 0) {
+		free(vmas);
+		return;
+	}
+	if (thread_locality >= 0) {
+		llog("thekraken: numamig: pass %u: locality score before: %ld.%ld%% (pages), %d.%d%% (thread NUMA faults)\n", pass, local * 1000 / total / 10, local * 1000 / total % 10, thread_locality / 10, thread_locality % 10);
+	} else {
+		llog("thekraken: numamig: pass %u: locality score before: %ld.%ld%% (pages)\n", pass, local * 1000 / total / 10, local * 1000 / total % 10);
+	}
+
+	for (i = 0; i < n && budget > 0; i++) {
+		if (vmas[i].misplaced)
+			moved += migrate_vma(&vmas[i], &budget);
+	}
+	free(vmas);
+
+	scan_threads();
+	scan_vmas(&vmas, &local_after, &total_after);
+	free(vmas);
+	if (total_after == 0) {
+		return;
+	}
+	llog("thekraken: numamig: pass %u: moved %ld pages, locality score after: %ld.%ld%% (pages)\n", pass, moved, local_after * 1000 / total_after / 10, local_after * 1000 / total_after % 10);
+}
+
+/*
+ * Forks a background job which periodically audits placement of FahCore's
+ * anonymous memory and migrates pages sitting on the "wrong" node (node no
+ * FahCore thread runs on, or other than the home node of a mapping that is
+ * used predominantly from one node).
+ *
+ * pid      - FahCore PID
+ * interval - number of seconds between passes
+ * rate     - maximum number of pages to migrate per second
+ * outlive  - keep running after we exit (until FahCore does)
+ */
+pid_t numamig_start(pid_t pid, unsigned int interval, unsigned int rate, int outlive)
+{
+	pid_t npid;
+	unsigned int pass;
+
+	npid = fork();
+	if (npid != 0) {
+		return npid;
+	}
+
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGHUP, SIG_DFL);
+	signal(SIGTSTP, SIG_DFL);
+	signal(SIGALRM, SIG_DFL);
+	if (outlive) {
+		setsid();
+	} else {
+		prctl(PR_SET_PDEATHSIG, SIGHUP);
+	}
+
+	target = pid;
+	_rate = rate;
+	pagesize = sysconf(_SC_PAGESIZE);
+
+	if (topo_nr_nodes() < 2) {
+		llog("thekraken: numamig: single node system, nothing to do\n");
+		_exit(0);
+	}
+	for (pass = 1; ; pass++) {
+		sleep(interval);
+		if (kill(target, 0)) {
+			_exit(0);
+		}
+		numamig_pass(pass, interval);
+	}
+}
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Observation mode: instead of tracing FahCore's syscalls, its stderr is
+ * put behind a pipe (forwarded to our stderr with tee(2)/splice(2) while
+ * being scanned) and its logfile is tailed with inotify.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "observe.h"
+#include "logscan.h"
+#include "llog.h"
+
+#define WORK_DIR "work"
+#define LOGFILE_PREFIX "logfile_"
+#define MAX_SEEN 16
+#define RETRY_MS 1000
+#define HEAD_SIZE 64
+
+struct seen {
+	char name[32];
+	off_t size;
+	char head[HEAD_SIZE];	/* to tell an appended logfile from a rewritten one */
+};
+
+static int errpipe[2] = { -1, -1 };	/* FahCore's stderr */
+static int scanpipe[2] = { -1, -1 };	/* copy of the above, for scanning */
+static int splice_ok;
+static int ino = -1;
+static int watching;
+
+static int logfd = -1;
+static char logname[32];
+static off_t logoff;
+
+/* logfiles present before FahCore started; their old contents are skipped */
+static struct seen seen[MAX_SEEN];
+static int nseen;
+
+static int is_logfile(const char *name)
+{
+	return !strncmp(name, LOGFILE_PREFIX, strlen(LOGFILE_PREFIX)) && strlen(name) < sizeof(logname);
+}
+
+static void watch(void)
+{
+	if (inotify_add_watch(ino, WORK_DIR, IN_MODIFY | IN_CREATE | IN_MOVED_TO) >= 0) {
+		watching = 1;
+		debug(1) llog("thekraken: observe: watching " WORK_DIR "/\n");
+	}
+}
+
+/* to be called before FahCore is forked */
+int observe_init(void)
+{
+	DIR *d;
+	struct dirent *de;
+
+	if (pipe2(errpipe, O_CLOEXEC)) {
+		return -1;
+	}
+	fcntl(errpipe[0], F_SETFL, O_NONBLOCK);
+	splice_ok = !pipe2(scanpipe, O_CLOEXEC | O_NONBLOCK);
+
+	ino = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (ino == -1) {
+		return -1;
+	}
+	watch();
+
+	d = opendir(WORK_DIR);
+	if (d) {
+		while ((de = readdir(d)) && nseen < MAX_SEEN) {
+			char fn[64];
+			struct stat st;
+			int fd;
+
+			if (!is_logfile(de->d_name))
+				continue;
+			snprintf(fn, sizeof(fn), WORK_DIR "/%s", de->d_name);
+			fd = open(fn, O_RDONLY | O_CLOEXEC);
+			if (fd == -1)
+				continue;
+			if (!fstat(fd, &st) && pread(fd, seen[nseen].head, HEAD_SIZE, 0) >= 0) {
+				snprintf(seen[nseen].name, sizeof(seen[nseen].name), "%s", de->d_name);
+				seen[nseen++].size = st.st_size;
+			}
+			close(fd);
+		}
+		closedir(d);
+	}
+	return 0;
+}
+
+/* to be called by FahCore child before exec */
+void observe_child(void)
+{
+	dup2(errpipe[1], STDERR_FILENO);
+	close(errpipe[1]);
+	close(errpipe[0]);
+}
+
+/* to be called by the wrapper once FahCore has been forked */
+void observe_parent(void)
+{
+	close(errpipe[1]);
+	errpipe[1] = -1;
+}
+
+int observe_errfd(void)
+{
+	return errpipe[0];
+}
+
+int observe_logfd(void)
+{
+	return ino;
+}
+
+/* poll() timeout; work/ might not exist yet */
+int observe_timeout(void)
+{
+	if (!watching) {
+		watch();
+	}
+	return watching ? -1 : RETRY_MS;
+}
+
+static void write_all(int fd, const char *buf, ssize_t n)
+{
+	while (n > 0) {
+		ssize_t w = write(fd, buf, n);
+
+		if (w <= 0) {
+			if (w == -1 && errno == EINTR)
+				continue;
+			return;
+		}
+		buf += w;
+		n -= w;
+	}
+}
+
+/*
+ * Forwards whatever FahCore wrote to stderr to our stderr (which is where
+ * FahCore's stderr would normally go) and scans it. Sets *eof once FahCore
+ * (and its children) closed stderr. Returns LOGSCAN_* events.
+ */
+int observe_stderr(struct logscan *ls, int *eof)
+{
+	char buf[4096];
+	int events = 0;
+
+	for (;;) {
+		ssize_t n;
+
+		if (splice_ok) {
+			n = tee(errpipe[0], scanpipe[1], sizeof(buf), SPLICE_F_NONBLOCK);
+			if (n > 0) {
+				ssize_t moved = 0, r;
+
+				while (moved < n) {
+					r = splice(errpipe[0], NULL, STDERR_FILENO, NULL, n - moved, SPLICE_F_MOVE);
+					if (r <= 0)
+						break;
+					moved += r;
+				}
+				if (moved < n) {
+					/* our stderr doesn't splice; copy the rest by hand from now on */
+					splice_ok = 0;
+					r = read(errpipe[0], buf, n - moved);
+					if (r > 0)
+						write_all(STDERR_FILENO, buf, r);
+				}
+				r = read(scanpipe[0], buf, n);
+				if (r > 0)
+					events |= logscan_feed(ls, buf, r);
+				continue;
+			}
+			if (n == -1 && errno == EINVAL) {
+				splice_ok = 0;
+			} else if (n == -1 && errno != EAGAIN) {
+				return events;
+			}
+			/* tee() doesn't tell EOF from empty pipe; read() will */
+		}
+		n = read(errpipe[0], buf, sizeof(buf));
+		if (n == 0) {
+			*eof = 1;
+			return events;
+		}
+		if (n < 0) {
+			return events;
+		}
+		write_all(STDERR_FILENO, buf, n);
+		events |= logscan_feed(ls, buf, n);
+	}
+}
+
+static void open_log(const char *name, char *slot)
+{
+	char fn[64];
+	int i;
+
+	if (logfd != -1) {
+		close(logfd);
+	}
+	snprintf(fn, sizeof(fn), WORK_DIR "/%s", name);
+	logfd = open(fn, O_RDONLY | O_CLOEXEC);
+	if (logfd == -1) {
+		return;
+	}
+	snprintf(logname, sizeof(logname), "%s", name);
+	logoff = 0;
+	for (i = 0; i < nseen; i++) {
+		char head[HEAD_SIZE] = { 0 };
+
+		if (strcmp(seen[i].name, name))
+			continue;
+		if (pread(logfd, head, HEAD_SIZE, 0) >= 0 && !memcmp(head, seen[i].head, HEAD_SIZE))
+			logoff = seen[i].size;
+	}
+	llog("thekraken: observe: tailing %s (from offset %ld)\n", fn, (long)logoff);
+	if (name[8] != '\0' && name[9] != '\0') {
+		slot[0] = name[8];
+		slot[1] = name[9];
+		slot[2] = '\0';
+	}
+}
+
+/*
+ * Handles inotify events; reads whatever got appended to FahCore's logfile
+ * and scans it. Fills 'slot' once the logfile is known. Returns LOGSCAN_*
+ * events.
+ */
+int observe_log(struct logscan *ls, char *slot)
+{
+	char evbuf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	char buf[4096];
+	int events = 0, changed = 0;
+	ssize_t n;
+
+	while ((n = read(ino, evbuf, sizeof(evbuf))) > 0) {
+		char *p;
+
+		for (p = evbuf; p < evbuf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+			struct inotify_event *ev = (struct inotify_event *)p;
+
+			if (!ev->len || !is_logfile(ev->name))
+				continue;
+			if (logfd == -1 || strcmp(ev->name, logname)) {
+				open_log(ev->name, slot);
+			}
+			changed = 1;
+		}
+	}
+	if (!changed || logfd == -1) {
+		return 0;
+	}
+
+	{
+		struct stat st;
+
+		if (!fstat(logfd, &st) && st.st_size < logoff) {
+			/* truncated */
+			logoff = 0;
+		}
+	}
+	while ((n = pread(logfd, buf, sizeof(buf), logoff)) > 0) {
+		logoff += n;
+		events |= logscan_feed(ls, buf, n);
+	}
+	return events;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "placement.h"
+#include "topology.h"
+
+static char *place_names[PLACE_MAX] = { "linear", "scatter", "compact", "preferred" };
+
+/* sort key of a cpu; compared lexicographically */
+struct key {
+	int k[4];
+	int cpu;
+};
+
+int place_parse(const char *s)
+{
+	int i;
+
+	for (i = 0; i < PLACE_MAX; i++) {
+		if (!strcmp(s, place_names[i]))
+			return i;
+	}
+	return -1;
+}
+
+const char *place_name(int policy)
+{
+	return place_names[policy];
+}
+
+static int key_cmp(const void *a, const void *b)
+{
+	const struct key *x = a, *y = b;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (x->k[i] != y->k[i])
+			return x->k[i] < y->k[i] ? -1 : 1;
+	}
+	return x->cpu - y->cpu;
+}
+
+/* number of candidates preceding 'cpu' and sharing its 'what' (core, llc) and sibling rank 'sib' */
+static int rank_within(struct key *keys, int n, int cpu, int (*what)(int), int sib)
+{
+	int i, r = 0;
+
+	for (i = 0; i < n && keys[i].cpu < cpu; i++) {
+		if (what(keys[i].cpu) == what(cpu) && (sib < 0 || keys[i].k[1] == sib))
+			r++;
+	}
+	return r;
+}
+
+/* sorts keys[0..n) according to 'policy' */
+static void sort_keys(int policy, struct key *keys, int n)
+{
+	int i;
+
+	switch (policy) {
+		case PLACE_LINEAR:
+			/* ascending cpu numbers; key_cmp() falls back to them */
+			break;
+		case PLACE_PREFERRED:
+			/* first threads of cores before SMT siblings, most capable first */
+			for (i = 0; i < n; i++) {
+				keys[i].k[0] = rank_within(keys, n, keys[i].cpu, topo_cpu_core, -1);
+				keys[i].k[1] = -topo_cpu_capacity(keys[i].cpu);
+			}
+			break;
+		case PLACE_COMPACT:
+			for (i = 0; i < n; i++) {
+				keys[i].k[0] = topo_cpu_node(keys[i].cpu);
+				keys[i].k[1] = topo_cpu_llc(keys[i].cpu);
+				keys[i].k[2] = topo_cpu_core(keys[i].cpu);
+			}
+			break;
+		case PLACE_SCATTER:
+			/* order within node: sibling rank, position within llc, llc */
+			for (i = 0; i < n; i++) {
+				keys[i].k[0] = topo_cpu_node(keys[i].cpu);
+				keys[i].k[1] = rank_within(keys, n, keys[i].cpu, topo_cpu_core, -1);
+			}
+			for (i = 0; i < n; i++) {
+				keys[i].k[2] = rank_within(keys, n, keys[i].cpu, topo_cpu_llc, keys[i].k[1]);
+				keys[i].k[3] = topo_cpu_llc(keys[i].cpu);
+			}
+			qsort(keys, n, sizeof(*keys), key_cmp);
+			/* then interleave nodes: position within node first */
+			for (i = 0; i < n; i++) {
+				int node = keys[i].k[0];
+
+				keys[i].k[0] = i > 0 && keys[i - 1].k[1] == node ? keys[i - 1].k[0] + 1 : 0;
+				keys[i].k[1] = node;
+				keys[i].k[2] = keys[i].k[3] = 0;
+			}
+			break;
+	}
+	qsort(keys, n, sizeof(*keys), key_cmp);
+}
+
+/*
+ * Fills 'order' (topo_nr_cpus() entries) with usable cpus starting at
+ * 'start' in the order FahCore threads should be bound to them:
+ *
+ *   linear  - ascending cpu numbers (traditional behaviour)
+ *   scatter - round robin across nodes, then across last level caches;
+ *             first threads of cores before their SMT siblings
+ *   compact - fill node by node, cache by cache, core by core (SMT
+ *             siblings next to each other)
+ *   preferred - first threads of cores by descending capacity (preferred
+ *             cores, boost), then SMT siblings the same way
+ *
+ * On hybrid machines each policy is applied to performance cores first and
+ * efficiency cores follow, so ranks share a core class whenever they fit.
+ * Isolated cpus (isolcpus, nohz_full) come before all others.
+ *
+ * Returns number of cpus in 'order'.
+ */
+int place_order(int policy, int start, int *order)
+{
+	struct key *keys;
+	int total = 0, iso, class, n, i, cpu;
+
+	keys = malloc(topo_nr_cpus() * sizeof(*keys));
+	for (iso = 1; iso >= 0; iso--) {
+		for (class = 0; class < topo_nr_classes(); class++) {
+			n = 0;
+			for (cpu = topo_next_usable(start); cpu >= 0; cpu = topo_next_usable(cpu + 1)) {
+				if (topo_cpu_isolated(cpu) != iso || topo_cpu_class(cpu) != class)
+					continue;
+				memset(&keys[n], 0, sizeof(*keys));
+				keys[n++].cpu = cpu;
+			}
+			sort_keys(policy, keys, n);
+			for (i = 0; i < n; i++) {
+				order[total++] = keys[i].cpu;
+			}
+		}
+	}
+	free(keys);
+	return total;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __PLACEMENT_H
+#define __PLACEMENT_H
+
+#define PLACE_LINEAR 0
+#define PLACE_SCATTER 1
+#define PLACE_COMPACT 2
+#define PLACE_PREFERRED 3
+#define PLACE_MAX 4
+
+int place_parse(const char *s);
+const char *place_name(int policy);
+int place_order(int policy, int start, int *order);
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Placement plan cache. The client restarts FahCore on every WU (and
+ * after every crash); instead of working out cpu order again, the plan is
+ * kept in PLAN_FN next to the config file: struct plan_hdr followed by
+ * 'norder' cpu numbers. The key is an FNV-1a hash of cheap inputs the
+ * plan depends on -- possible, online and usable cpus (affinity mask),
+ * their nodes and isolation as read by topo_init(), snapshot root,
+ * placement settings, core name and np -- so a plan is recomputed and
+ * overwritten when cpus are offlined, the mask or the config changes.
+ * Hardware changes that keep cpu numbering (another cpu model, SMT or
+ * cache layout switched in firmware) are caught by a few files standing
+ * in for the rest: cpu model name, SMT siblings and cache sharing of the
+ * first usable cpu. Reading all per-cpu files would cost as much as
+ * computing the plan.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "plancache.h"
+#include "topology.h"
+
+#define CPU_DIR "/sys/devices/system/cpu"
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t fnv(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		h ^= *p++;
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+static uint64_t fnv_int(uint64_t h, int v)
+{
+	return fnv(h, &v, sizeof(v));
+}
+
+/* hashes the first line of 'fn' starting with 'prefix'; returns -1 if there's none */
+static int fnv_line(uint64_t *h, const char *fn, const char *prefix)
+{
+	char buf[256];
+	int ret = -1;
+	FILE *fp;
+
+	fp = fopen(fn, "r");
+	if (!fp) {
+		return -1;
+	}
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (!strncmp(buf, prefix, strlen(prefix))) {
+			*h = fnv(*h, buf, strlen(buf));
+			ret = 0;
+			break;
+		}
+	}
+	fclose(fp);
+	return ret;
+}
+
+/* cpu model, SMT siblings and cache sharing of 'cpu' */
+static uint64_t fnv_hw(uint64_t h, int cpu)
+{
+	char fn[PATH_MAX];
+	int idx;
+
+	fnv_line(&h, topo_path(fn, sizeof(fn), "/proc/cpuinfo"), "model name");
+	fnv_line(&h, topo_path(fn, sizeof(fn), CPU_DIR "/cpu%d/topology/thread_siblings_list", cpu), "");
+	for (idx = 0; ; idx++) {
+		if (fnv_line(&h, topo_path(fn, sizeof(fn), CPU_DIR "/cpu%d/cache/index%d/shared_cpu_list", cpu, idx), ""))
+			break;
+	}
+	return h;
+}
+
+uint64_t plan_key(int policy, int start, int isolate, const char *core, int np)
+{
+	uint64_t h = FNV_OFFSET;
+	int cpu;
+
+	h = fnv_int(h, topo_nr_cpus());
+	h = fnv_int(h, topo_nr_nodes());
+	/* what topo_init() read anyway */
+	for (cpu = 0; cpu < topo_nr_cpus(); cpu++) {
+		h = fnv_int(h, topo_cpu_usable(cpu));
+		if (!topo_cpu_usable(cpu))
+			continue;
+		h = fnv_int(h, topo_cpu_node(cpu));
+		h = fnv_int(h, topo_cpu_isolated(cpu));
+	}
+	h = fnv_hw(h, topo_next_usable(0));
+	h = fnv(h, topo_root(), strlen(topo_root()) + 1);
+	h = fnv_int(h, policy);
+	h = fnv_int(h, start);
+	h = fnv_int(h, isolate);
+	h = fnv(h, core, strlen(core) + 1);
+	return fnv_int(h, np);
+}
+
+/*
+ * Fills 'order' (topo_nr_cpus() entries) from plan cache 'fn' if it was
+ * saved under 'key'. Returns number of cpus in 'order', -1 if there's no
+ * usable plan.
+ */
+int plan_load(const char *fn, uint64_t key, int *order)
+{
+	const struct plan_hdr *h;
+	struct stat st;
+	void *p;
+	int fd, n = -1, i;
+
+	fd = open(fn, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return -1;
+	}
+	if (fstat(fd, &st) || st.st_size < sizeof(*h)) {
+		close(fd);
+		return -1;
+	}
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		return -1;
+	}
+	h = p;
+	if (!memcmp(h->magic, PLAN_MAGIC, sizeof(h->magic)) && h->key == key && h->ncpus == topo_nr_cpus()
+	    && h->norder >= 0 && h->norder <= h->ncpus && st.st_size == sizeof(*h) + h->norder * sizeof(int32_t)) {
+		const int32_t *cpus = (const int32_t *)(h + 1);
+
+		for (i = 0; i < h->norder; i++) {
+			/* a hash collision shouldn't get us to bind anywhere odd */
+			if (cpus[i] < 0 || cpus[i] >= h->ncpus || !topo_cpu_usable(cpus[i]))
+				break;
+			order[i] = cpus[i];
+		}
+		if (i == h->norder)
+			n = h->norder;
+	}
+	munmap(p, st.st_size);
+	return n;
+}
+
+/* stores plan 'order' ('norder' cpus) under 'key'; replaces 'fn' atomically */
+int plan_save(const char *fn, uint64_t key, const int *order, int norder)
+{
+	char tmp[4096];
+	struct plan_hdr h;
+	int32_t cpus[norder > 0 ? norder : 1];
+	int fd, i, rv = 0;
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", fn, (int)getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		return -1;
+	}
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, PLAN_MAGIC, sizeof(h.magic));
+	h.key = key;
+	h.ncpus = topo_nr_cpus();
+	h.norder = norder;
+	for (i = 0; i < norder; i++) {
+		cpus[i] = order[i];
+	}
+	if (write(fd, &h, sizeof(h)) != sizeof(h) || write(fd, cpus, norder * sizeof(*cpus)) != norder * sizeof(*cpus)) {
+		rv = -1;
+	}
+	close(fd);
+	if (!rv && rename(tmp, fn)) {
+		rv = -1;
+	}
+	if (rv) {
+		unlink(tmp);
+	}
+	return rv;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __PLANCACHE_H
+#define __PLANCACHE_H
+
+#include <stdint.h>
+
+#define PLAN_FN "thekraken.plan"
+#define PLAN_MAGIC "tkplan2\n"
+
+struct plan_hdr {
+	char magic[8];	/* PLAN_MAGIC */
+	uint64_t key;	/* plan_key() of what the plan was computed for */
+	int32_t ncpus;	/* topo_nr_cpus() */
+	int32_t norder;	/* cpus that follow */
+};
+
+uint64_t plan_key(int policy, int start, int isolate, const char *core, int np);
+int plan_load(const char *fn, uint64_t key, int *order);
+int plan_save(const char *fn, uint64_t key, const int *order, int norder);
+
+#endif
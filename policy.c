@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <sched.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#include "policy.h"
+#include "llog.h"
+
+#ifndef SCHED_BATCH
+#define SCHED_BATCH 3
+#endif
+#ifndef SCHED_IDLE
+#define SCHED_IDLE 5
+#endif
+
+#define SCHED_FLAG_KEEP_PARAMS 0x10
+#define SCHED_FLAG_UTIL_CLAMP_MIN 0x20
+#define SCHED_FLAG_UTIL_CLAMP_MAX 0x40
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+
+#define UNSET (-1000)
+
+/* struct sched_attr as of Linux 5.3 (with utilization clamping) */
+struct kattr {
+	unsigned int size;
+	unsigned int sched_policy;
+	unsigned long long sched_flags;
+	int sched_nice;
+	unsigned int sched_priority;
+	unsigned long long sched_runtime;
+	unsigned long long sched_deadline;
+	unsigned long long sched_period;
+	unsigned int sched_util_min;
+	unsigned int sched_util_max;
+};
+
+struct policy {
+	int defined;
+	int policy;
+	int nice;
+	int uclamp_min;
+	int uclamp_max;
+	int ioprio;
+};
+
+static struct policy policies[ROLE_MAX] = {
+	[0 ... ROLE_MAX - 1] = { 0, UNSET, UNSET, UNSET, UNSET, UNSET },
+};
+
+static char *role_names[ROLE_MAX] = { "main", "master", "rank", "helper", "synthload" };
+
+static char *policy_names[] = { "other", NULL, NULL, "batch", NULL, "idle" };
+
+static int failed[ROLE_MAX]; /* complain only once per role */
+
+const char *policy_role_name(int role)
+{
+	return role_names[role];
+}
+
+int policy_defined(int role)
+{
+	return policies[role].defined;
+}
+
+static int parse_ioprio(const char *s, int *ioprio)
+{
+	char *end;
+	long data = 0;
+	int class;
+
+	if (!strncmp(s, "none", 4) && (s[4] == ',' || s[4] == '\0')) {
+		*ioprio = 0;
+		return 0;
+	}
+	if (!strncmp(s, "idle", 4) && (s[4] == ',' || s[4] == '\0')) {
+		*ioprio = 3 << IOPRIO_CLASS_SHIFT;
+		return 0;
+	}
+	if (!strncmp(s, "rt/", 3)) {
+		class = 1;
+	} else if (!strncmp(s, "be/", 3)) {
+		class = 2;
+	} else {
+		return -1;
+	}
+	data = strtol(s + 3, &end, 10);
+	if ((*end != '\0' && *end != ',') || data < 0 || data > 7) {
+		return -1;
+	}
+	*ioprio = class << IOPRIO_CLASS_SHIFT | data;
+	return 0;
+}
+
+/*
+ * Parses scheduling policy specification of 'role', i.e. comma separated
+ * list of: other|batch|idle, nice=N, uclamp_min=N, uclamp_max=N and
+ * ioprio=none|idle|be/N|rt/N. Returns 0 on success.
+ */
+int policy_parse(int role, const char *s)
+{
+	struct policy p = { 1, UNSET, UNSET, UNSET, UNSET, UNSET };
+
+	while (*s) {
+		char *end;
+		int i;
+
+		for (i = 0; i < sizeof(policy_names) / sizeof(*policy_names); i++) {
+			int len;
+
+			if (!policy_names[i])
+				continue;
+			len = strlen(policy_names[i]);
+			if (!strncmp(s, policy_names[i], len) && (s[len] == ',' || s[len] == '\0')) {
+				p.policy = i;
+				s += len;
+				break;
+			}
+		}
+		if (i < sizeof(policy_names) / sizeof(*policy_names)) {
+			/* matched policy name */
+		} else if (!strncmp(s, "nice=", 5)) {
+			p.nice = strtol(s + 5, &end, 10);
+			if (end == s + 5 || p.nice < -20 || p.nice > 19)
+				return -1;
+			s = end;
+		} else if (!strncmp(s, "uclamp_min=", 11)) {
+			p.uclamp_min = strtol(s + 11, &end, 10);
+			if (end == s + 11 || p.uclamp_min < 0 || p.uclamp_min > 1024)
+				return -1;
+			s = end;
+		} else if (!strncmp(s, "uclamp_max=", 11)) {
+			p.uclamp_max = strtol(s + 11, &end, 10);
+			if (end == s + 11 || p.uclamp_max < 0 || p.uclamp_max > 1024)
+				return -1;
+			s = end;
+		} else if (!strncmp(s, "ioprio=", 7)) {
+			if (parse_ioprio(s + 7, &p.ioprio))
+				return -1;
+			s = strchr(s, ',');
+			if (!s)
+				break;
+		} else {
+			return -1;
+		}
+		if (*s == ',') {
+			s++;
+		} else if (*s != '\0') {
+			return -1;
+		}
+	}
+	policies[role] = p;
+	return 0;
+}
+
+/*
+ * Applies scheduling policy, nice level, utilization clamps and I/O
+ * priority of 'role' to thread 'tid' (0 being the calling thread).
+ */
+void policy_apply(int role, pid_t tid)
+{
+	struct policy *p = &policies[role];
+	struct kattr attr;
+	long r;
+
+	if (!p->defined) {
+		return;
+	}
+	if (p->policy != UNSET || p->nice != UNSET || p->uclamp_min != UNSET || p->uclamp_max != UNSET) {
+		memset(&attr, 0, sizeof(attr));
+		/* never write back an attr we failed to read */
+		r = syscall(SYS_sched_getattr, tid, &attr, sizeof(attr), 0);
+		if (r == 0) {
+			attr.size = sizeof(attr);
+			attr.sched_flags = 0;
+			if (p->policy != UNSET)
+				attr.sched_policy = p->policy;
+			if (p->nice != UNSET)
+				attr.sched_nice = p->nice;
+			if (p->policy == UNSET && p->nice == UNSET)
+				attr.sched_flags |= SCHED_FLAG_KEEP_PARAMS;
+			if (p->uclamp_min != UNSET) {
+				attr.sched_flags |= SCHED_FLAG_UTIL_CLAMP_MIN;
+				attr.sched_util_min = p->uclamp_min;
+			}
+			if (p->uclamp_max != UNSET) {
+				attr.sched_flags |= SCHED_FLAG_UTIL_CLAMP_MAX;
+				attr.sched_util_max = p->uclamp_max;
+			}
+			r = syscall(SYS_sched_setattr, tid, &attr, 0);
+		}
+		if (r) {
+			struct sched_param sp = { 0 };
+
+			if (!failed[role]) {
+				llog("thekraken: policy: sched_%sattr(%s, %d): %s\n", attr.size ? "set" : "get", role_names[role], tid, strerror(errno));
+				failed[role] = 1;
+			}
+			/* older kernels: no sched_setattr(); fall back to policy and nice */
+			if (p->policy != UNSET)
+				sched_setscheduler(tid, p->policy, &sp);
+			if (p->nice != UNSET)
+				setpriority(PRIO_PROCESS, tid, p->nice);
+		}
+	}
+	if (p->ioprio != UNSET) {
+		if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, p->ioprio) && !failed[role]) {
+			llog("thekraken: policy: ioprio_set(%s, %d): %s\n", role_names[role], tid, strerror(errno));
+			failed[role] = 1;
+		}
+	}
+	debug(2) llog("thekraken: policy: applied '%s' policy to %d\n", role_names[role], tid);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __POLICY_H
+#define __POLICY_H
+
+#include <sys/types.h>
+
+/* thread roles */
+#define ROLE_MAIN 0		/* FahCore main thread */
+#define ROLE_MASTER 1		/* talkative thread (writes logfile and checkpoints) */
+#define ROLE_RANK 2		/* compute threads */
+#define ROLE_HELPER 3		/* unbound helper threads */
+#define ROLE_SYNTHLOAD 4	/* synthload manager and workers */
+#define ROLE_MAX 5
+
+int policy_parse(int role, const char *s);
+int policy_defined(int role);
+void policy_apply(int role, pid_t tid);
+const char *policy_role_name(int role);
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Power management for the lifetime of a WU: cpufreq energy performance
+ * preference (intel_pstate, amd-pstate in active mode) or, where there's
+ * none, scaling governor of the cpus FahCore runs on set to performance,
+ * and a PM QoS request on /dev/cpu_dma_latency keeping deep C-states
+ * (and their exit latency) away from barrier-heavy runs. Original
+ * settings are saved the first time they get changed and put back by
+ * power_restore(), which only uses async-signal-safe calls so it can be
+ * called from signal handlers. All paths go through topo_path().
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "power.h"
+#include "topology.h"
+
+#define CPUFREQ_FMT "/sys/devices/system/cpu/cpu%d/cpufreq/"
+#define QOS_DEV "/dev/cpu_dma_latency"
+#define PERFORMANCE "performance"
+
+struct saved {
+	char path[PATH_MAX];
+	char val[64];
+};
+
+static struct saved *saved;
+static int nsaved;
+static pid_t owner; /* forked children leave our settings alone */
+static int qos_fd = -1;
+
+static int read_val(const char *fn, char *buf, int size)
+{
+	int fd, n;
+
+	fd = open(fn, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	n = read(fd, buf, size - 1);
+	close(fd);
+	if (n <= 0)
+		return -1;
+	buf[n] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
+}
+
+static int write_val(const char *fn, const char *val)
+{
+	int fd, rv;
+
+	fd = open(fn, O_WRONLY | O_TRUNC | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	rv = write(fd, val, strlen(val)) == strlen(val) ? 0 : -1;
+	if (close(fd))
+		rv = -1;
+	return rv;
+}
+
+/* saves current value of 'fn' (unless saved already) and writes 'val' */
+static int save_write(const char *fn, const char *val)
+{
+	char old[64];
+	int i;
+
+	for (i = 0; i < nsaved; i++) {
+		if (!strcmp(saved[i].path, fn))
+			return 0;
+	}
+	if (read_val(fn, old, sizeof(old)))
+		return -1;
+	if (!strcmp(old, val))
+		return 0;
+	if (write_val(fn, val))
+		return -1;
+	snprintf(saved[nsaved].path, sizeof(saved[nsaved].path), "%s", fn);
+	snprintf(saved[nsaved].val, sizeof(saved[nsaved].val), "%s", old);
+	nsaved++;
+	return 0;
+}
+
+/*
+ * Sets the first 'n' cpus of 'cpus' to performance: energy performance
+ * preference where the driver has one, scaling governor otherwise.
+ * Returns number of cpus set (or already running that way); 'epp' gets
+ * how many of them through energy performance preference.
+ */
+int power_apply(const int *cpus, int n, int *epp)
+{
+	char fn[PATH_MAX], buf[256];
+	int i, done = 0;
+
+	owner = getpid();
+	if (!saved) {
+		/* two settings per cpu at most */
+		saved = malloc(2 * topo_nr_cpus() * sizeof(*saved));
+		if (!saved)
+			return 0;
+	}
+	*epp = 0;
+	for (i = 0; i < n; i++) {
+		topo_path(fn, sizeof(fn), CPUFREQ_FMT "scaling_governor", cpus[i]);
+		if (read_val(fn, buf, sizeof(buf)))
+			continue;
+		if (!strcmp(buf, PERFORMANCE)) {
+			/* EPP is fixed at performance then */
+			done++;
+			continue;
+		}
+		topo_path(fn, sizeof(fn), CPUFREQ_FMT "energy_performance_preference", cpus[i]);
+		if (!access(fn, F_OK)) {
+			if (!save_write(fn, PERFORMANCE)) {
+				(*epp)++;
+				done++;
+			}
+			continue;
+		}
+		topo_path(fn, sizeof(fn), CPUFREQ_FMT "scaling_available_governors", cpus[i]);
+		if (read_val(fn, buf, sizeof(buf)) || !strstr(buf, PERFORMANCE))
+			continue;
+		topo_path(fn, sizeof(fn), CPUFREQ_FMT "scaling_governor", cpus[i]);
+		if (!save_write(fn, PERFORMANCE))
+			done++;
+	}
+	return done;
+}
+
+/*
+ * Holds a PM QoS request for 'latency' us of cpu wake-up latency until
+ * power_restore(); the kernel drops it once the device gets closed.
+ */
+int power_qos(int latency)
+{
+	char fn[PATH_MAX];
+	int32_t v = latency;
+
+	owner = getpid();
+	if (qos_fd == -1) {
+		qos_fd = open(topo_path(fn, sizeof(fn), QOS_DEV), O_WRONLY | O_CLOEXEC);
+		if (qos_fd == -1)
+			return -1;
+	}
+	if (write(qos_fd, &v, sizeof(v)) != sizeof(v)) {
+		close(qos_fd);
+		qos_fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+/* puts back everything changed; async-signal-safe. Returns number of cpufreq settings restored */
+int power_restore(void)
+{
+	int i, n = 0;
+
+	if (getpid() != owner) {
+		return 0;
+	}
+	for (i = 0; i < nsaved; i++) {
+		if (!write_val(saved[i].path, saved[i].val))
+			n++;
+	}
+	nsaved = 0;
+	if (qos_fd != -1) {
+		close(qos_fd);
+		qos_fd = -1;
+	}
+	return n;
+}
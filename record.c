@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Recordings of what FahCore's talkative threads were seen to do (logfile
+ * opens, writes to logfile and stderr) and of its thread creation for
+ * replaying them through the log scanner without a live FahCore.
+ *
+ * Format: RECORD_MAGIC, then for every event struct rec_hdr followed by
+ * 'len' bytes of payload (pathname or written data, as far as the
+ * scanner got to see it).
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "record.h"
+
+static int recfd = -1;
+static struct timespec t0;
+
+/* starts recording to 'fn' (truncated) */
+int record_open(const char *fn)
+{
+	recfd = open(fn, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (recfd == -1) {
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (write(recfd, RECORD_MAGIC, strlen(RECORD_MAGIC)) != strlen(RECORD_MAGIC)) {
+		close(recfd);
+		recfd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+void record_event(int type, int fd, const char *data, int len)
+{
+	struct timespec t;
+	struct rec_hdr h;
+	struct iovec iov[2];
+
+	if (recfd == -1) {
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	h.ms = (t.tv_sec - t0.tv_sec) * 1000 + (t.tv_nsec - t0.tv_nsec) / 1000000;
+	h.type = type;
+	h.fd = fd;
+	h.len = len;
+	iov[0].iov_base = &h;
+	iov[0].iov_len = sizeof(h);
+	iov[1].iov_base = (void *)data;
+	iov[1].iov_len = len;
+	writev(recfd, iov, 2);
+}
+
+/* maps recording 'fn'; returns its events (past the magic) and their size in 'size' */
+const char *record_load(const char *fn, size_t *size)
+{
+	struct stat st;
+	char *p;
+	int fd;
+
+	fd = open(fn, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return NULL;
+	}
+	if (fstat(fd, &st) || st.st_size < strlen(RECORD_MAGIC)) {
+		close(fd);
+		return NULL;
+	}
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		return NULL;
+	}
+	if (memcmp(p, RECORD_MAGIC, strlen(RECORD_MAGIC))) {
+		munmap(p, st.st_size);
+		return NULL;
+	}
+	*size = st.st_size - strlen(RECORD_MAGIC);
+	return p + strlen(RECORD_MAGIC);
+}
+
+/*
+ * Returns event at '*pos' of events 'buf' ('size' bytes) and advances
+ * '*pos' past it; NULL at the end (or on a truncated event).
+ */
+const struct rec_hdr *record_next(const char *buf, size_t size, size_t *pos)
+{
+	const struct rec_hdr *h;
+
+	if (*pos + sizeof(*h) > size) {
+		return NULL;
+	}
+	h = (const struct rec_hdr *)(buf + *pos);
+	if (*pos + sizeof(*h) + h->len > size) {
+		return NULL;
+	}
+	*pos += sizeof(*h) + h->len;
+	return h;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __RECORD_H
+#define __RECORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RECORD_FN "thekraken.rec"
+#define RECORD_MAGIC "thekraken-rec 1\n"
+
+#define REC_OPEN 1	/* logfile opened; fd: returned fd, payload: pathname */
+#define REC_WRITE 2	/* payload: data written to fd */
+#define REC_CLONE 3	/* FahCore thread created; fd: its clone number, no payload */
+
+struct rec_hdr {
+	uint32_t ms;	/* since start of recording */
+	uint8_t type;	/* REC_* */
+	int32_t fd;
+	uint16_t len;	/* of payload that follows */
+} __attribute__ ((packed));
+
+#define REC_DATA(h) ((const char *)((h) + 1))
+
+int record_open(const char *fn);
+void record_event(int type, int fd, const char *data, int len);
+const char *record_load(const char *fn, size_t *size);
+const struct rec_hdr *record_next(const char *buf, size_t size, size_t *pos);
+
+#endif
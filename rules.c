@@ -0,0 +1,430 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * FahCore argv/environment rewriting. Rules come from 'rule=' lines of
+ * the config file (any number of them, applied in order), from presets
+ * ('preset=' lines) and built-ins (remap_np):
+ *
+ *   [cond[,cond...]:] action
+ *
+ * cond is <var><op><value>, var one of core, np, cpus, nodes, classes,
+ * op one of = != < <= > >=; core compares FahCore name or its suffix
+ * (a5 matches FahCore_a5), np is -np as rewritten by rules so far.
+ * Actions:
+ *
+ *   env NAME=VALUE   set environment variable
+ *   unset NAME       remove environment variable
+ *   set OPT VALUE    replace value of option OPT, appending it if absent
+ *   add ARG          append argument
+ *
+ * ${np}, ${cpus}, ${nodes} and ${classes} in VALUE and ARG are replaced
+ * with their values.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "rules.h"
+#include "topology.h"
+#include "llog.h"
+
+#define RULE_MAX_CONDS 4
+#define RULE_LEN 256
+#define RULE_MAX_ARGS 64 /* arguments rules may add */
+
+#define OP_EQ 0
+#define OP_NE 1
+#define OP_LT 2
+#define OP_LE 3
+#define OP_GT 4
+#define OP_GE 5
+
+#define ACT_ENV 0
+#define ACT_UNSET 1
+#define ACT_SET 2
+#define ACT_ADD 3
+
+struct cond {
+	char var[8];
+	int op;
+	char val[32];
+};
+
+struct rule {
+	char text[RULE_LEN];	/* as given, for the log */
+	struct cond conds[RULE_MAX_CONDS];
+	int nconds;
+	int action;
+	char arg[RULE_LEN];
+	char val[RULE_LEN];
+};
+
+static struct rule rules[RULES_MAX];
+static int nrules;
+
+static const char *vars[] = { "core", "np", "cpus", "nodes", "classes", NULL };
+static const char *ops[] = { "=", "!=", "<", "<=", ">", ">=" };
+static const char *actions[] = { "env", "unset", "set", "add", NULL };
+
+/* benchmarkable sets of rules; 'preset=name' adds them */
+static const struct {
+	const char *name;
+	const char *rules[4];
+} presets[] = {
+	/* OpenMP threads sleep while waiting; cheaper when cpus are shared (synthload) */
+	{ "omp-passive", { "env OMP_WAIT_POLICY=PASSIVE", "env GOMP_SPINCOUNT=0", NULL } },
+	/* OpenMP threads spin while waiting; lowest wake-up latency on dedicated cpus */
+	{ "omp-active", { "env OMP_WAIT_POLICY=ACTIVE", "env GOMP_SPINCOUNT=infinity", NULL } },
+	/* one rank per usable cpu, whatever the client asked for */
+	{ "np-cpus", { "np>0: set -np ${cpus}", NULL } },
+	/* leave the pinning to us */
+	{ "gmx-nopin", { "env GMX_NO_PINNING=1", "env GMX_NO_AFFINITY=1", NULL } },
+	{ NULL }
+};
+
+static int find(const char **list, const char *s, size_t len)
+{
+	int i;
+
+	for (i = 0; list[i]; i++) {
+		if (strlen(list[i]) == len && !strncmp(list[i], s, len))
+			return i;
+	}
+	return -1;
+}
+
+static int parse_cond(const char *s, size_t len, struct cond *c)
+{
+	size_t v = 0, o;
+
+	while (v < len && isalpha(s[v]))
+		v++;
+	if (v == 0 || v >= sizeof(c->var) || find(vars, s, v) < 0)
+		return -1;
+	memcpy(c->var, s, v);
+	c->var[v] = '\0';
+	o = v;
+	while (o < len && strchr("=!<>", s[o]))
+		o++;
+	for (c->op = OP_GE; c->op >= 0; c->op--) {
+		if (strlen(ops[c->op]) == o - v && !strncmp(ops[c->op], s + v, o - v))
+			break;
+	}
+	if (c->op < 0 || o == len || len - o >= sizeof(c->val))
+		return -1;
+	memcpy(c->val, s + o, len - o);
+	c->val[len - o] = '\0';
+	return 0;
+}
+
+/* parses rule 's' into 'r'; -1 if it's malformed */
+static int parse(const char *s, struct rule *r)
+{
+	const char *p = s, *q;
+	size_t len;
+
+	memset(r, 0, sizeof(*r));
+	if (strlen(s) >= sizeof(r->text))
+		return -1;
+	strcpy(r->text, s);
+
+	q = strpbrk(p, " \t");
+	if (q && q > p && q[-1] == ':') {
+		/* conditions */
+		while (p < q - 1) {
+			len = strcspn(p, ",:");
+			if (r->nconds == RULE_MAX_CONDS || parse_cond(p, len, &r->conds[r->nconds++]))
+				return -1;
+			p += len + (p[len] == ',');
+		}
+		p = q;
+	}
+	p += strspn(p, " \t");
+	len = strcspn(p, " \t");
+	r->action = find(actions, p, len);
+	if (r->action < 0)
+		return -1;
+	p += len;
+	p += strspn(p, " \t");
+
+	switch (r->action) {
+		case ACT_ENV:
+			q = strchr(p, '=');
+			if (!q || q == p)
+				return -1;
+			snprintf(r->arg, sizeof(r->arg), "%.*s", (int)(q - p), p);
+			snprintf(r->val, sizeof(r->val), "%s", q + 1);
+			break;
+		case ACT_SET:
+			len = strcspn(p, " \t");
+			if (!len || !p[len])
+				return -1;
+			snprintf(r->arg, sizeof(r->arg), "%.*s", (int)len, p);
+			p += len;
+			p += strspn(p, " \t");
+			snprintf(r->val, sizeof(r->val), "%s", p);
+			break;
+		case ACT_UNSET:
+		case ACT_ADD:
+			if (!*p)
+				return -1;
+			snprintf(r->arg, sizeof(r->arg), "%s", p);
+			break;
+	}
+	return 0;
+}
+
+/* adds rule 's' after (or, with 'first', before) those added so far; -1 if malformed */
+int rules_add(const char *s, int first)
+{
+	struct rule r;
+	char buf[RULE_LEN];
+	size_t len = strcspn(s, "\r\n");
+
+	if (nrules == RULES_MAX || len >= sizeof(buf)) {
+		return -1;
+	}
+	memcpy(buf, s, len);
+	buf[len] = '\0';
+	if (parse(buf, &r)) {
+		return -1;
+	}
+	if (first) {
+		memmove(&rules[1], &rules[0], nrules * sizeof(*rules));
+		rules[0] = r;
+	} else {
+		rules[nrules] = r;
+	}
+	nrules++;
+	return 0;
+}
+
+/* adds rules of preset 'name'; -1 if there's no such preset */
+int rules_preset(const char *name)
+{
+	int i, j;
+
+	for (i = 0; presets[i].name; i++) {
+		if (strcmp(presets[i].name, name))
+			continue;
+		for (j = 0; presets[i].rules[j]; j++) {
+			rules_add(presets[i].rules[j], 0);
+		}
+		return 0;
+	}
+	return -1;
+}
+
+/* value of -np in 'av' ('ac' arguments); 0 if none */
+static int get_np(int ac, char **av)
+{
+	int i;
+
+	for (i = 1; i < ac - 1; i++) {
+		if (!strcmp(av[i], "-np"))
+			return atoi(av[i + 1]);
+	}
+	return 0;
+}
+
+static int var(const struct rule_ctx *ctx, int np, const char *name)
+{
+	if (!strcmp(name, "np"))
+		return np;
+	if (!strcmp(name, "cpus"))
+		return ctx->cpus;
+	if (!strcmp(name, "nodes"))
+		return ctx->nodes;
+	/* reads capacity of every cpu; only done if some rule asks */
+	return topo_nr_classes();
+}
+
+static int holds(const struct cond *c, const struct rule_ctx *ctx, int np)
+{
+	int cmp;
+
+	if (!strcmp(c->var, "core")) {
+		const char *u = strrchr(ctx->core, '_');
+
+		cmp = strcasecmp(ctx->core, c->val) && !(u && !strcasecmp(u + 1, c->val));
+	} else {
+		int a = var(ctx, np, c->var), b = atoi(c->val);
+
+		cmp = a < b ? -1 : a > b;
+	}
+	switch (c->op) {
+		case OP_EQ:
+			return cmp == 0;
+		case OP_NE:
+			return cmp != 0;
+		case OP_LT:
+			return cmp < 0;
+		case OP_LE:
+			return cmp <= 0;
+		case OP_GT:
+			return cmp > 0;
+	}
+	return cmp >= 0;
+}
+
+/* 's' with ${var} replaced; malloc'ed */
+static char *expand(const char *s, const struct rule_ctx *ctx, int np)
+{
+	char out[RULE_LEN * 2];
+	size_t n = 0;
+	int i;
+
+	while (*s && n < sizeof(out) - 16) {
+		if (s[0] == '$' && s[1] == '{') {
+			size_t len = strcspn(s + 2, "}");
+
+			i = find(vars, s + 2, len);
+			if (i > 0 && s[2 + len] == '}') {
+				n += snprintf(out + n, sizeof(out) - n, "%d", var(ctx, np, vars[i]));
+				s += len + 3;
+				continue;
+			}
+		}
+		out[n++] = *s++;
+	}
+	out[n] = '\0';
+	return strdup(out);
+}
+
+static void set_env(char ***env, int *nenv, const char *name, char *entry)
+{
+	size_t len = strlen(name);
+	int i;
+
+	for (i = 0; i < *nenv; i++) {
+		if (!strncmp((*env)[i], name, len) && (*env)[i][len] == '=')
+			break;
+	}
+	if (i == *nenv && entry) {
+		*env = realloc(*env, (*nenv + 2) * sizeof(**env));
+		(*nenv)++;
+	} else if (i == *nenv) {
+		return;
+	}
+	if (entry) {
+		(*env)[i] = entry;
+	} else {
+		(*env)[i] = (*env)[--(*nenv)];
+	}
+	(*env)[*nenv] = NULL;
+}
+
+/*
+ * Applies rules to FahCore's 'av' ('ac' arguments) and our environment;
+ * results (malloc'ed, NULL terminated) go to 'argv_out' and 'envp_out'.
+ * Every rule applied, final argv and variables touched are logged.
+ * Returns -np in the final argv (0 if none).
+ */
+int rules_apply(int ac, char **av, const struct rule_ctx *ctx, char ***argv_out, char ***envp_out)
+{
+	extern char **environ;
+	char **argv, **env;
+	int nargv = ac, nenv = 0, np, i, j;
+	char line[1024];
+	size_t n;
+
+	argv = malloc((ac + RULE_MAX_ARGS + 1) * sizeof(*argv));
+	memcpy(argv, av, ac * sizeof(*argv));
+	argv[ac] = NULL;
+	while (environ[nenv])
+		nenv++;
+	env = malloc((nenv + 1) * sizeof(*env));
+	memcpy(env, environ, (nenv + 1) * sizeof(*env));
+
+	np = get_np(nargv, argv);
+	for (i = 0; i < nrules; i++) {
+		struct rule *r = &rules[i];
+		char *e, *entry;
+
+		for (j = 0; j < r->nconds; j++) {
+			if (!holds(&r->conds[j], ctx, np))
+				break;
+		}
+		if (j < r->nconds)
+			continue;
+		switch (r->action) {
+			case ACT_ENV:
+				e = expand(r->val, ctx, np);
+				n = strlen(r->arg) + strlen(e) + 2;
+				entry = malloc(n);
+				snprintf(entry, n, "%s=%s", r->arg, e);
+				set_env(&env, &nenv, r->arg, entry);
+				free(e);
+				break;
+			case ACT_UNSET:
+				set_env(&env, &nenv, r->arg, NULL);
+				break;
+			case ACT_SET:
+				for (j = 1; j < nargv - 1; j++) {
+					if (!strcmp(argv[j], r->arg))
+						break;
+				}
+				if (j < nargv - 1) {
+					argv[j + 1] = expand(r->val, ctx, np);
+				} else if (nargv + 2 <= ac + RULE_MAX_ARGS) {
+					argv[nargv++] = r->arg;
+					argv[nargv++] = expand(r->val, ctx, np);
+				}
+				break;
+			case ACT_ADD:
+				if (nargv < ac + RULE_MAX_ARGS) {
+					argv[nargv++] = expand(r->arg, ctx, np);
+				}
+				break;
+		}
+		argv[nargv] = NULL;
+		np = get_np(nargv, argv);
+		llog("thekraken: rule applied: %s\n", r->text);
+	}
+
+	n = 0;
+	for (i = 0; i < nargv && n < sizeof(line) - 1; i++) {
+		n += snprintf(line + n, sizeof(line) - n, i ? " %s" : "%s", argv[i]);
+	}
+	llog("thekraken: FahCore argv: %s\n", line);
+	for (i = 0; i < nrules; i++) {
+		const char *name = rules[i].arg;
+		size_t len = strlen(name);
+
+		if (rules[i].action != ACT_ENV && rules[i].action != ACT_UNSET)
+			continue;
+		for (j = 0; j < i; j++) {
+			if (!strcmp(rules[j].arg, name) && (rules[j].action == ACT_ENV || rules[j].action == ACT_UNSET))
+				break;
+		}
+		if (j < i)
+			continue; /* logged already */
+		for (j = 0; j < nenv; j++) {
+			if (!strncmp(env[j], name, len) && env[j][len] == '=')
+				break;
+		}
+		llog("thekraken: FahCore env: %s%s\n", j < nenv ? env[j] : name, j < nenv ? "" : " (unset)");
+	}
+	*argv_out = argv;
+	*envp_out = env;
+	return np;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __RULES_H
+#define __RULES_H
+
+#define RULES_MAX 64
+
+/* what rule conditions are checked against */
+struct rule_ctx {
+	const char *core;	/* FahCore_xx */
+	int cpus;		/* usable */
+	int nodes;
+};
+
+int rules_add(const char *s, int first);
+int rules_preset(const char *name);
+int rules_apply(int ac, char **av, const struct rule_ctx *ctx, char ***argv_out, char ***envp_out);
+
+#endif
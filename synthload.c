@@ -27,6 +27,9 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#include "policy.h"
+#include "topology.h"
+
 static unsigned int _offperiod;
 static timer_t load_timer, deadline_timer;
 
@@ -81,15 +84,17 @@ static void setup_alarms(unsigned int onperiod, unsigned int offperiod, unsigned
 	timer_settime(deadline_timer, 0, &its_deadline, NULL);
 }
 
-static void bindcpu(pid_t pid, int cpu)
+static const int *_cpus;
+static int _ncpus;
+
+/* binds 'pid' to 'i'-th cpu FahCore threads get bound to */
+static void bindcpu(pid_t pid, int i)
 {
-	cpu_set_t cpuset;
-	CPU_ZERO(&cpuset);
-	CPU_SET(cpu, &cpuset);
-	sched_setaffinity(pid, sizeof(cpuset), &cpuset);
+	if (i < _ncpus)
+		topo_bind(pid, _cpus[i]);
 }
 
-static int create_workers(int workers, int startcpu, unsigned int onperiod, unsigned int offperiod, unsigned int deadline)
+static int create_workers(int workers, int i, unsigned int onperiod, unsigned int offperiod, unsigned int deadline)
 {
 	int pid;
 
@@ -100,12 +105,13 @@ static int create_workers(int workers, int startcpu, unsigned int onperiod, unsi
 		}
 		if (pid == 0) {
 			prctl(PR_SET_PDEATHSIG, SIGHUP);
+			policy_apply(ROLE_SYNTHLOAD, 0);
 			setup_alarms(onperiod, offperiod, deadline);
 			load();
 		}
 		else {
-			bindcpu(pid, startcpu);
-			startcpu += 2;
+			bindcpu(pid, i);
+			i += 2;
 		}
 	}
 
@@ -123,14 +129,17 @@ static int create_workers(int workers, int startcpu, unsigned int onperiod, unsi
  * offperiod - number of ms to sleep before starting the next load/sleep cycle
  * deadline  - number of ms before the load/sleep cycle should stop
  * workers   - number of processes that should be loading CPUs
- * startcpu  - CPU number that the kraken started binding FahCore processes to
+ * cpus      - CPUs (in order) the kraken binds FahCore processes to
+ * ncpus     - number of entries in cpus
  */
-pid_t synthload_start(unsigned int onperiod, unsigned int offperiod, unsigned int deadline, int workers, int startcpu)
+pid_t synthload_start(unsigned int onperiod, unsigned int offperiod, unsigned int deadline, int workers, const int *cpus, int ncpus)
 {
 	int mpid;
 	struct sigaction sa;
 
 	_offperiod = offperiod;
+	_cpus = cpus;
+	_ncpus = ncpus;
 
 	/* fork the manager process */
 	mpid = fork();
@@ -148,10 +157,12 @@ pid_t synthload_start(unsigned int onperiod, unsigned int offperiod, unsigned in
 		
 		signal(SIGCHLD, sigchldhandler);
 		prctl(PR_SET_PDEATHSIG, SIGHUP);
+		policy_apply(ROLE_SYNTHLOAD, 0);
 
 		sigemptyset(&unblock);
 		sigaddset(&unblock, SIGTERM);
 		sigaddset(&unblock, SIGHUP);
+		sigaddset(&unblock, SIGCHLD); /* blocked by the kraken (signalfd) */
 		sigprocmask(SIG_UNBLOCK, &unblock, NULL);
 
 		/* create the handler for SIGALRM so the handler will receive extra info */
@@ -160,13 +171,13 @@ pid_t synthload_start(unsigned int onperiod, unsigned int offperiod, unsigned in
 		sigemptyset(&sa.sa_mask);
 		sigaction(SIGALRM, &sa, NULL);
 
-		if (create_workers(workers-1, startcpu+3, onperiod, offperiod, deadline) != 0)
+		if (create_workers(workers-1, 3, onperiod, offperiod, deadline) != 0)
 			return -2;
 
 		setup_alarms(onperiod, offperiod, deadline);
 		load();
 	} else {
-		bindcpu(mpid, startcpu+1);
+		bindcpu(mpid, 1);
 	}
 	
 	return mpid;
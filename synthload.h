@@ -17,4 +17,4 @@
  *
  */
 
-pid_t synthload_start(unsigned int onperiod, unsigned int offperiod, unsigned int deadline, int workers, int startcpu);
+pid_t synthload_start(unsigned int onperiod, unsigned int offperiod, unsigned int deadline, int workers, const int *cpus, int ncpus);
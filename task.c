@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "task.h"
+
+#define WORD_BITS (8 * sizeof(unsigned long))
+
+static struct task tasks[TASK_MAX];
+static int ntasks;
+
+/*
+ * Slots are positions in placement order (cpus planned for master and
+ * ranks); a set bit means taken. Threads hand theirs back on exit, so
+ * cores re-creating worker threads get the same cpus again.
+ */
+static unsigned long *slots;
+static int nslots;
+
+/*
+ * Returns NULL if the table is full; the slot (if any) is owned by the
+ * task from now on and freed by task_remove().
+ */
+struct task *task_add(pid_t tid, int role, int clone, int slot, int cpu)
+{
+	struct task *t;
+
+	if (ntasks == TASK_MAX) {
+		task_slot_free(slot);
+		return NULL;
+	}
+	t = &tasks[ntasks++];
+	t->tid = tid;
+	t->role = role;
+	t->clone = clone;
+	t->slot = slot;
+	t->cpu = cpu;
+	return t;
+}
+
+struct task *task_find(pid_t tid)
+{
+	int i;
+
+	for (i = 0; i < ntasks; i++) {
+		if (tasks[i].tid == tid)
+			return &tasks[i];
+	}
+	return NULL;
+}
+
+void task_remove(pid_t tid)
+{
+	struct task *t = task_find(tid);
+
+	if (t) {
+		task_slot_free(t->slot);
+		*t = tasks[--ntasks];
+	}
+}
+
+int task_count(void)
+{
+	return ntasks;
+}
+
+struct task *task_at(int i)
+{
+	return &tasks[i];
+}
+
+/* (re)creates 'n' free slots; tasks holding slots should be gone by now */
+void task_slots_init(int n)
+{
+	free(slots);
+	nslots = n;
+	slots = calloc((n + WORD_BITS - 1) / WORD_BITS + 1, sizeof(*slots));
+}
+
+/* takes the lowest free slot; -1 if all are taken */
+int task_slot_alloc(void)
+{
+	int i, slot;
+
+	for (i = 0; i * WORD_BITS < nslots; i++) {
+		if (~slots[i] == 0)
+			continue;
+		slot = i * WORD_BITS + __builtin_ctzl(~slots[i]);
+		if (slot >= nslots)
+			break;
+		slots[i] |= 1UL << (slot % WORD_BITS);
+		return slot;
+	}
+	return -1;
+}
+
+void task_slot_free(int slot)
+{
+	if (slot >= 0 && slot < nslots) {
+		slots[slot / WORD_BITS] &= ~(1UL << (slot % WORD_BITS));
+	}
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __TASK_H
+#define __TASK_H
+
+#include <sys/types.h>
+
+#define TASK_MAX 1024
+
+/* FahCore thread, as seen by The Kraken */
+struct task {
+	pid_t tid;
+	int role;	/* ROLE_* */
+	int clone;	/* clone number, 0 for main thread */
+	int slot;	/* position in placement order, -1 if none */
+	int cpu;	/* cpu bound to, -1 if unbound */
+};
+
+struct task *task_add(pid_t tid, int role, int clone, int slot, int cpu);
+struct task *task_find(pid_t tid);
+void task_remove(pid_t tid);
+int task_count(void);
+struct task *task_at(int i);
+void task_slots_init(int nslots);
+int task_slot_alloc(void);
+void task_slot_free(int slot);
+
+#endif
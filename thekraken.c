@@ -39,10 +39,38 @@
 #include <ctype.h>
 
 #include <time.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <stdarg.h>
 
 #include "version.h"
 #include "build.h"
 #include "synthload.h"
+#include "topology.h"
+#include "numamig.h"
+#include "thp.h"
+#include "policy.h"
+#include "task.h"
+#include "commaff.h"
+#include "iostat.h"
+#include "placement.h"
+#include "logscan.h"
+#include "observe.h"
+#include "ledger.h"
+#include "ctl.h"
+#include "wrap.h"
+#include "attach.h"
+#include "record.h"
+#include "warmup.h"
+#include "irqaff.h"
+#include "plancache.h"
+#include "throttle.h"
+#include "energy.h"
+#include "affguard.h"
+#include "rules.h"
+#include "watchdog.h"
+#include "power.h"
 #include "llog.h"
 
 #define WELCOME_LINE1 "thekraken: The Kraken " VERSION " %s\n"
@@ -54,7 +82,6 @@
 #define CA5 "FahCore_a5.exe"
 #define CA3 "FahCore_a3.exe"
 #define CA4 "FahCore_a4.exe"
-#define SIZE_THRESH 204800
 #define LOGFN "thekraken.log"
 #define LOGFN_PREV "thekraken-prev.log"
 #define INSTALL_FMT "thekraken-%s"
@@ -73,10 +100,6 @@ static pid_t cpid; /* FahCore PID */
 static int custom_config;
 
 static char wdbuf[PATH_MAX];
-static char *k_getwd(void)
-{
-	return getcwd(wdbuf, sizeof(wdbuf));
-}
 
 #define STR_BUF_SIZE 144
 static void sighandler(int n)
@@ -85,6 +108,18 @@ static void sighandler(int n)
 
 	llogp(logfd, buf, sizeof(buf), "thekraken: %d: (sighandler) got signal 0x%08x\n", getpid(), n);
 	write(logfd, buf, strlen(buf));
+	if (cpid <= 0) {
+		if (n == SIGTSTP) {
+			/* stop without losing the handler (SIGSTOP can't be caught) */
+			raise(SIGSTOP);
+			return;
+		}
+		/* no FahCore to pass it to (yet); go down with power settings put back */
+		power_restore();
+		signal(n, SIG_DFL);
+		raise(n);
+		return;
+	}
 	kill(cpid, n);
 }
 
@@ -103,66 +138,79 @@ static void sigalrmhandler(int n)
 	//kill(cpid, SIGKILL);
 }
 
-static int do_wrap(char *s)
-{
-	int fd1, fd2;
-	char buf[8192];
-	int rv, rv2;;
-	
-	fd1 = open("/proc/self/exe", O_RDONLY);
-	fd2 = open(s, O_WRONLY | O_TRUNC | O_CREAT, S_IRWXU | S_IRWXG | S_IRWXO);
-	if (fd1 == -1 || fd2 == -1)
-		goto out_err;
-	while ((rv = read(fd1, buf, sizeof(buf))) > 0) {
-		rv2 = write(fd2, buf, rv);
-		if (rv2 != rv)
-			goto out_err;
-	}
-	close(fd1);
-	close(fd2);
-	
-	return 0;
-out_err:
-	close(fd1);
-	close(fd2);
-	return -1;
-}
-
 #define OPT_YES 1
 #define OPT_NOMODIFY 2
 
-static int wrap(char *s, int options)
+/*
+ * Wraps core 's' in 'dfd': a fresh copy of ourselves is prepared under a
+ * temporary name, the core gets hard linked to its INSTALL_FMT name and
+ * the copy is renamed over the core, so there's always something to run.
+ * Wrappers of other versions are replaced the same way.
+ */
+static int wrap(int dfd, char *s, int options)
 {
 	struct stat st;
 	char fn[32];
+	char tmp[48];
+	char tag[64];
+	int upgrade = 0, linked = 0;
+	int rv;
 	
-	if (stat(s, &st)) {
+	if (fstatat(dfd, s, &st, 0)) {
 		return -1;
 	}
 	if (!S_ISREG(st.st_mode)) {
 		return -1;
 	}
-	if (st.st_size < SIZE_THRESH) {
-		return 1; /* already wrapped */
-	}
-	if (options & OPT_NOMODIFY) {
-		return 0;
-	}
 	sprintf(fn, INSTALL_FMT, s);
-	if (rename(s, fn)) {
+	rv = wrap_check(dfd, s, tag, sizeof(tag));
+	if (rv == -1) {
 		return 2; /* problems, no wrapping performed */
 	}
+	if (rv != WRAP_NONE) {
+		struct stat ost;
+
+		if ((rv == WRAP_MARKED && !strcmp(tag, wrap_marker)) || fstatat(dfd, fn, &ost, 0)) {
+			return 1; /* already wrapped */
+		}
+		upgrade = 1;
+	}
+	if (options & OPT_NOMODIFY) {
+		return upgrade ? 4 : 0;
+	}
+	sprintf(tmp, "." INSTALL_FMT ".tmp", s);
+	unlinkat(dfd, tmp, 0); /* leftover of an interrupted run */
 	setfsuid(st.st_uid); /* reasonable assumption: files and directory they reside in are owned by the same user */
 	setfsgid(st.st_gid);
-	if (do_wrap(s)) {
-		setfsuid(geteuid());
-		setfsgid(getegid());
-		rename(fn, s);
-		return 3; /* problems, no wrapping performed */
+	if (wrap_copy_self(dfd, tmp)) {
+		rv = 3; /* problems, no wrapping performed */
+		goto out;
+	}
+	if (!upgrade) {
+		if (!linkat(dfd, s, dfd, fn, 0)) {
+			linked = 1;
+		} else if (renameat(dfd, s, dfd, fn)) {
+			/* no hard links on this filesystem and no rename either */
+			unlinkat(dfd, tmp, 0);
+			rv = 2; /* problems, no wrapping performed */
+			goto out;
+		}
+	}
+	if (renameat(dfd, tmp, dfd, s)) {
+		unlinkat(dfd, tmp, 0);
+		if (linked) {
+			unlinkat(dfd, fn, 0);
+		} else if (!upgrade) {
+			renameat(dfd, fn, dfd, s);
+		}
+		rv = 3; /* problems, no wrapping performed */
+		goto out;
 	}
+	rv = upgrade ? 4 : 0;
+out:
 	setfsuid(geteuid());
 	setfsgid(getegid());
-	return 0;
+	return rv;
 }
 
 static void wrap_summary(char *d, char *s, int rv)
@@ -177,22 +225,26 @@ static void wrap_summary(char *d, char *s, int rv)
 		case 1:
 			llog("thekraken: '%s/%s' already wrapped, no wrapping performed\n", d, s);
 			break;
+		case 4:
+			llog("thekraken: '%s/%s' wrapper upgraded\n", d, s);
+			break;
 		default:
 			llog("thekraken: '%s/%s' problems occurred during wrapping, no wrapping performed (code %d)\n", d, s, rv);
 	}
 }
 
-static int list_wrap(int options, int *counter, int *total)
+static int list_wrap(int dfd, char *d, int options, int *counter, int *total)
 {
 	char **s = core_list;
 	int rv;
-	char *d = k_getwd();
 	int ret = 0;
 	
 	while (*s) {
-		if (!(rv = wrap(*s, options))) {
+		if (!(rv = wrap(dfd, *s, options))) {
 			(*counter)++;
 			ret = 1;
+		} else if (rv == 4) {
+			(*counter)++;
 		}
 		if (rv >= 0) {
 			(*total)++;
@@ -203,7 +255,7 @@ static int list_wrap(int options, int *counter, int *total)
 	return ret;
 }
 
-static int unwrap(char *s, int options)
+static int unwrap(int dfd, char *s, int options)
 {
 	char fn[32];
 	int rv;
@@ -211,7 +263,7 @@ static int unwrap(char *s, int options)
 	
 	sprintf(fn, INSTALL_FMT, s);
 
-	if (stat(fn, &st)) {
+	if (fstatat(dfd, fn, &st, 0)) {
 		return -1;
 	}
 	if (!S_ISREG(st.st_mode)) {
@@ -221,7 +273,7 @@ static int unwrap(char *s, int options)
 		return 0;
 	}
 
-	rv = rename(fn, s);
+	rv = renameat(dfd, fn, dfd, s);
 	if (rv == -1) {
 		rv = 1;
 	}
@@ -242,15 +294,14 @@ static void unwrap_summary(char *d, char *s, int rv)
 	}
 }
 
-static int list_unwrap(int options, int *counter, int *total)
+static int list_unwrap(int dfd, char *d, int options, int *counter, int *total)
 {
 	char **s = core_list;
 	int rv;
-	char *d = k_getwd();
 	int ret = 0;
 	
 	while (*s) {
-		if (!(rv = unwrap(*s, options))) {
+		if (!(rv = unwrap(dfd, *s, options))) {
 			(*counter)++;
 			ret = 1;
 		}
@@ -272,7 +323,37 @@ static int list_unwrap(int options, int *counter, int *total)
 #define CONF_STARTUP_DEADLINE 5
 #define CONF_V 6
 #define CONF_REMAP_NP 7
-#define CONF_MAX 8
+#define CONF_NUMAMIG 8
+#define CONF_NUMAMIG_INTERVAL 9
+#define CONF_NUMAMIG_RATE 10
+#define CONF_THP 11
+#define CONF_THP_MINSIZE 12
+#define CONF_THP_CHUNK 13
+#define CONF_THP_INTERVAL 14
+#define CONF_SCHED_MAIN 15 /* ROLE_* order */
+#define CONF_SCHED_MASTER 16
+#define CONF_SCHED_RANK 17
+#define CONF_SCHED_HELPER 18
+#define CONF_SCHED_SYNTHLOAD 19
+#define CONF_COMMAFF 20
+#define CONF_COMMAFF_PERIOD 21
+#define CONF_IOSTAT 22
+#define CONF_PLACEMENT 23
+#define CONF_OBSERVE 24
+#define CONF_AUTOTUNE 25
+#define CONF_AUTOTUNE_EXPLORE 26
+#define CONF_CONTROL 27
+#define CONF_RECORD 28
+#define CONF_WARMUP 29
+#define CONF_ISOLATE 30
+#define CONF_DLBLOAD_ENGINE 31
+#define CONF_ENERGY 32
+#define CONF_SETAFFINITY 33
+#define CONF_WATCHDOG 34
+#define CONF_WATCHDOG_RESTART 35
+#define CONF_POWER 36
+#define CONF_POWER_LATENCY 37
+#define CONF_MAX 38
 
 #define DEFAULT_STARTCPU 0
 #define DEFAULT_DLBLOAD 1
@@ -282,13 +363,39 @@ static int list_unwrap(int options, int *counter, int *total)
 #define DEFAULT_STARTUP_DEADLINE 300 /* 5 minutes */
 #define DEFAULT_V 0
 #define DEFAULT_REMAP_NP 1
+#define REMAP_NP_RULE "np=40: set -np 44"
+#define DEFAULT_NUMAMIG 0
+#define DEFAULT_NUMAMIG_INTERVAL 60 /* seconds */
+#define DEFAULT_NUMAMIG_RATE 2048 /* pages per second */
+#define DEFAULT_THP 0
+#define DEFAULT_THP_MINSIZE 16 /* MB */
+#define DEFAULT_THP_CHUNK 2 /* MB */
+#define DEFAULT_THP_INTERVAL 50 /* ms */
+#define DEFAULT_COMMAFF 0
+#define DEFAULT_COMMAFF_PERIOD 60 /* seconds */
+#define DEFAULT_IOSTAT 0
+#define DEFAULT_PLACEMENT PLACE_LINEAR
+#define DEFAULT_OBSERVE 0
+#define DEFAULT_AUTOTUNE 0
+#define DEFAULT_AUTOTUNE_EXPLORE 10 /* percent of WUs */
+#define DEFAULT_CONTROL 1
+#define DEFAULT_RECORD 0
+#define DEFAULT_WARMUP 0
+#define DEFAULT_ISOLATE 0
+#define DEFAULT_DLBLOAD_ENGINE 0 /* 0: synthload, 1: throttle ranks */
+#define DEFAULT_ENERGY 0
+#define DEFAULT_SETAFFINITY 0 /* AFF_*: 0 off, 1 log, 2 rewrite, 3 deny */
+#define DEFAULT_WATCHDOG 0 /* stall when no progress for this many times rolling TPF; 0 off */
+#define DEFAULT_WATCHDOG_RESTART 0
+#define DEFAULT_POWER 0
+#define DEFAULT_POWER_LATENCY 0 /* us, /dev/cpu_dma_latency request with power=1 */
 
 static char **conf_line;
 static int conf_index;
 static int conf_total;
 static int conf_step = 4;
 
-static char *conf_key[] = { "startcpu", "dlbload", "dlbload_onperiod", "dlbload_offperiod", "dlbload_deadline", "startup_deadline", "v", "remap_np", NULL };
+static char *conf_key[] = { "startcpu", "dlbload", "dlbload_onperiod", "dlbload_offperiod", "dlbload_deadline", "startup_deadline", "v", "remap_np", "numamig", "numamig_interval", "numamig_rate", "thp", "thp_minsize", "thp_chunk", "thp_interval", "sched_main", "sched_master", "sched_rank", "sched_helper", "sched_synthload", "commaff", "commaff_period", "iostat", "placement", "observe", "autotune", "autotune_explore", "control", "record", "warmup", "isolate", "dlbload_engine", "energy", "setaffinity", "watchdog", "watchdog_restart", "power", "power_latency", NULL };
 static char *conf_val[sizeof(conf_key)/sizeof(char *)];
 
 static unsigned int conf_startcpu = DEFAULT_STARTCPU;
@@ -299,6 +406,33 @@ static unsigned int conf_dlbload_deadline = DEFAULT_DLBLOAD_DEADLINE;
 static unsigned int conf_startup_deadline = DEFAULT_STARTUP_DEADLINE;
 static unsigned int conf_v = DEFAULT_V;
 static unsigned int conf_remap_np = DEFAULT_REMAP_NP;
+static unsigned int conf_numamig = DEFAULT_NUMAMIG;
+static unsigned int conf_numamig_interval = DEFAULT_NUMAMIG_INTERVAL;
+static unsigned int conf_numamig_rate = DEFAULT_NUMAMIG_RATE;
+static unsigned int conf_thp = DEFAULT_THP;
+static unsigned int conf_thp_minsize = DEFAULT_THP_MINSIZE;
+static unsigned int conf_thp_chunk = DEFAULT_THP_CHUNK;
+static unsigned int conf_thp_interval = DEFAULT_THP_INTERVAL;
+static unsigned int conf_commaff = DEFAULT_COMMAFF;
+static unsigned int conf_commaff_period = DEFAULT_COMMAFF_PERIOD;
+static unsigned int conf_iostat = DEFAULT_IOSTAT;
+static unsigned int conf_placement = DEFAULT_PLACEMENT;
+static unsigned int conf_observe = DEFAULT_OBSERVE;
+static unsigned int conf_autotune = DEFAULT_AUTOTUNE;
+static unsigned int conf_autotune_explore = DEFAULT_AUTOTUNE_EXPLORE;
+static unsigned int conf_control = DEFAULT_CONTROL;
+static unsigned int conf_record = DEFAULT_RECORD;
+static unsigned int conf_warmup = DEFAULT_WARMUP;
+static unsigned int conf_isolate = DEFAULT_ISOLATE;
+static unsigned int conf_dlbload_engine = DEFAULT_DLBLOAD_ENGINE;
+static unsigned int conf_energy = DEFAULT_ENERGY;
+static unsigned int conf_setaffinity = DEFAULT_SETAFFINITY;
+static unsigned int conf_watchdog = DEFAULT_WATCHDOG;
+static unsigned int conf_watchdog_restart = DEFAULT_WATCHDOG_RESTART;
+static unsigned int conf_power = DEFAULT_POWER;
+static unsigned int conf_power_latency = DEFAULT_POWER_LATENCY;
+/* variable behind each conf_key entry; NULL for scheduling policies (kept by policy.c) */
+static unsigned int *conf_var[] = { &conf_startcpu, &conf_dlbload, &conf_dlbload_onperiod, &conf_dlbload_offperiod, &conf_dlbload_deadline, &conf_startup_deadline, &conf_v, &conf_remap_np, &conf_numamig, &conf_numamig_interval, &conf_numamig_rate, &conf_thp, &conf_thp_minsize, &conf_thp_chunk, &conf_thp_interval, NULL, NULL, NULL, NULL, NULL, &conf_commaff, &conf_commaff_period, &conf_iostat, &conf_placement, &conf_observe, &conf_autotune, &conf_autotune_explore, &conf_control, &conf_record, &conf_warmup, &conf_isolate, &conf_dlbload_engine, &conf_energy, &conf_setaffinity, &conf_watchdog, &conf_watchdog_restart, &conf_power, &conf_power_latency, NULL };
 
 static void conf_line_add(char *s)
 {
@@ -318,7 +452,7 @@ static int conf_validate_one(int n)
 		char *end;
 		
 		conf_startcpu = strtol(conf_val[CONF_STARTCPU], &end, 10);
-		if (*end != '\0' || conf_startcpu > 128) {
+		if (*end != '\0' || conf_startcpu >= topo_nr_cpus()) {
 			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_STARTCPU], conf_val[CONF_STARTCPU]);
 			ret = 1;
 			conf_startcpu = DEFAULT_STARTCPU;
@@ -418,6 +552,340 @@ static int conf_validate_one(int n)
 		}
 		return ret;
 	}
+	if (n == CONF_NUMAMIG && conf_val[CONF_NUMAMIG]) {
+		char *end;
+		
+		conf_numamig = strtol(conf_val[CONF_NUMAMIG], &end, 10);
+		if (*end != '\0' || conf_numamig > 1) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_NUMAMIG], conf_val[CONF_NUMAMIG]);
+			ret = 1;
+			conf_numamig = DEFAULT_NUMAMIG;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_NUMAMIG], conf_numamig);
+		}
+		return ret;
+	}
+	if (n == CONF_NUMAMIG_INTERVAL && conf_val[CONF_NUMAMIG_INTERVAL]) {
+		char *end;
+		
+		conf_numamig_interval = strtol(conf_val[CONF_NUMAMIG_INTERVAL], &end, 10);
+		if (*end != '\0' || conf_numamig_interval == 0) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_NUMAMIG_INTERVAL], conf_val[CONF_NUMAMIG_INTERVAL]);
+			ret = 1;
+			conf_numamig_interval = DEFAULT_NUMAMIG_INTERVAL;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_NUMAMIG_INTERVAL], conf_numamig_interval);
+		}
+		return ret;
+	}
+	if (n == CONF_NUMAMIG_RATE && conf_val[CONF_NUMAMIG_RATE]) {
+		char *end;
+		
+		conf_numamig_rate = strtol(conf_val[CONF_NUMAMIG_RATE], &end, 10);
+		if (*end != '\0' || conf_numamig_rate == 0) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_NUMAMIG_RATE], conf_val[CONF_NUMAMIG_RATE]);
+			ret = 1;
+			conf_numamig_rate = DEFAULT_NUMAMIG_RATE;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_NUMAMIG_RATE], conf_numamig_rate);
+		}
+		return ret;
+	}
+	if (n == CONF_THP && conf_val[CONF_THP]) {
+		char *end;
+		
+		conf_thp = strtol(conf_val[CONF_THP], &end, 10);
+		if (*end != '\0' || conf_thp > 1) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_THP], conf_val[CONF_THP]);
+			ret = 1;
+			conf_thp = DEFAULT_THP;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_THP], conf_thp);
+		}
+		return ret;
+	}
+	if (n == CONF_THP_MINSIZE && conf_val[CONF_THP_MINSIZE]) {
+		char *end;
+		
+		conf_thp_minsize = strtol(conf_val[CONF_THP_MINSIZE], &end, 10);
+		if (*end != '\0' || conf_thp_minsize == 0) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_THP_MINSIZE], conf_val[CONF_THP_MINSIZE]);
+			ret = 1;
+			conf_thp_minsize = DEFAULT_THP_MINSIZE;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_THP_MINSIZE], conf_thp_minsize);
+		}
+		return ret;
+	}
+	if (n == CONF_THP_CHUNK && conf_val[CONF_THP_CHUNK]) {
+		char *end;
+		
+		conf_thp_chunk = strtol(conf_val[CONF_THP_CHUNK], &end, 10);
+		if (*end != '\0' || conf_thp_chunk == 0 || conf_thp_chunk % 2) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_THP_CHUNK], conf_val[CONF_THP_CHUNK]);
+			ret = 1;
+			conf_thp_chunk = DEFAULT_THP_CHUNK;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_THP_CHUNK], conf_thp_chunk);
+		}
+		return ret;
+	}
+	if (n == CONF_THP_INTERVAL && conf_val[CONF_THP_INTERVAL]) {
+		char *end;
+		
+		conf_thp_interval = strtol(conf_val[CONF_THP_INTERVAL], &end, 10);
+		if (*end != '\0') {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_THP_INTERVAL], conf_val[CONF_THP_INTERVAL]);
+			ret = 1;
+			conf_thp_interval = DEFAULT_THP_INTERVAL;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_THP_INTERVAL], conf_thp_interval);
+		}
+		return ret;
+	}
+	if (n >= CONF_SCHED_MAIN && n <= CONF_SCHED_SYNTHLOAD && conf_val[n]) {
+		if (policy_parse(n - CONF_SCHED_MAIN, conf_val[n])) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[n], conf_val[n]);
+			ret = 1;
+		} else {
+			llog("thekraken: config: %s=%s\n", conf_key[n], conf_val[n]);
+		}
+		return ret;
+	}
+	if (n == CONF_COMMAFF && conf_val[CONF_COMMAFF]) {
+		char *end;
+		
+		conf_commaff = strtol(conf_val[CONF_COMMAFF], &end, 10);
+		if (*end != '\0' || conf_commaff > 1) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_COMMAFF], conf_val[CONF_COMMAFF]);
+			ret = 1;
+			conf_commaff = DEFAULT_COMMAFF;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_COMMAFF], conf_commaff);
+		}
+		return ret;
+	}
+	if (n == CONF_COMMAFF_PERIOD && conf_val[CONF_COMMAFF_PERIOD]) {
+		char *end;
+		
+		conf_commaff_period = strtol(conf_val[CONF_COMMAFF_PERIOD], &end, 10);
+		if (*end != '\0' || conf_commaff_period == 0) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_COMMAFF_PERIOD], conf_val[CONF_COMMAFF_PERIOD]);
+			ret = 1;
+			conf_commaff_period = DEFAULT_COMMAFF_PERIOD;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_COMMAFF_PERIOD], conf_commaff_period);
+		}
+		return ret;
+	}
+	if (n == CONF_IOSTAT && conf_val[CONF_IOSTAT]) {
+		char *end;
+		
+		conf_iostat = strtol(conf_val[CONF_IOSTAT], &end, 10);
+		if (*end != '\0' || conf_iostat > 1) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_IOSTAT], conf_val[CONF_IOSTAT]);
+			ret = 1;
+			conf_iostat = DEFAULT_IOSTAT;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_IOSTAT], conf_iostat);
+		}
+		return ret;
+	}
+	if (n == CONF_PLACEMENT && conf_val[CONF_PLACEMENT]) {
+		int policy = place_parse(conf_val[CONF_PLACEMENT]);
+
+		if (policy < 0) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_PLACEMENT], conf_val[CONF_PLACEMENT]);
+			ret = 1;
+			conf_placement = DEFAULT_PLACEMENT;
+		} else {
+			conf_placement = policy;
+			llog("thekraken: config: %s=%s\n", conf_key[CONF_PLACEMENT], conf_val[CONF_PLACEMENT]);
+		}
+		return ret;
+	}
+	if (n == CONF_OBSERVE && conf_val[CONF_OBSERVE]) {
+		char *end;
+		
+		conf_observe = strtol(conf_val[CONF_OBSERVE], &end, 10);
+		if (*end != '\0' || conf_observe > 1) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_OBSERVE], conf_val[CONF_OBSERVE]);
+			ret = 1;
+			conf_observe = DEFAULT_OBSERVE;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_OBSERVE], conf_observe);
+		}
+		return ret;
+	}
+	if (n == CONF_AUTOTUNE && conf_val[CONF_AUTOTUNE]) {
+		char *end;
+		
+		conf_autotune = strtol(conf_val[CONF_AUTOTUNE], &end, 10);
+		if (*end != '\0' || conf_autotune > 2) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_AUTOTUNE], conf_val[CONF_AUTOTUNE]);
+			ret = 1;
+			conf_autotune = DEFAULT_AUTOTUNE;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_AUTOTUNE], conf_autotune);
+		}
+		return ret;
+	}
+	if (n == CONF_AUTOTUNE_EXPLORE && conf_val[CONF_AUTOTUNE_EXPLORE]) {
+		char *end;
+		
+		conf_autotune_explore = strtol(conf_val[CONF_AUTOTUNE_EXPLORE], &end, 10);
+		if (*end != '\0' || conf_autotune_explore > 100) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_AUTOTUNE_EXPLORE], conf_val[CONF_AUTOTUNE_EXPLORE]);
+			ret = 1;
+			conf_autotune_explore = DEFAULT_AUTOTUNE_EXPLORE;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_AUTOTUNE_EXPLORE], conf_autotune_explore);
+		}
+		return ret;
+	}
+	if (n == CONF_CONTROL && conf_val[CONF_CONTROL]) {
+		char *end;
+		
+		conf_control = strtol(conf_val[CONF_CONTROL], &end, 10);
+		if (*end != '\0' || conf_control > 1) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_CONTROL], conf_val[CONF_CONTROL]);
+			ret = 1;
+			conf_control = DEFAULT_CONTROL;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_CONTROL], conf_control);
+		}
+		return ret;
+	}
+	if (n == CONF_RECORD && conf_val[CONF_RECORD]) {
+		char *end;
+		
+		conf_record = strtol(conf_val[CONF_RECORD], &end, 10);
+		if (*end != '\0' || conf_record > 1) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_RECORD], conf_val[CONF_RECORD]);
+			ret = 1;
+			conf_record = DEFAULT_RECORD;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_RECORD], conf_record);
+		}
+		return ret;
+	}
+	if (n == CONF_WARMUP && conf_val[CONF_WARMUP]) {
+		char *end;
+		
+		conf_warmup = strtol(conf_val[CONF_WARMUP], &end, 10);
+		if (*end != '\0' || conf_warmup > 1) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_WARMUP], conf_val[CONF_WARMUP]);
+			ret = 1;
+			conf_warmup = DEFAULT_WARMUP;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_WARMUP], conf_warmup);
+		}
+		return ret;
+	}
+	if (n == CONF_ISOLATE && conf_val[CONF_ISOLATE]) {
+		char *end;
+		
+		conf_isolate = strtol(conf_val[CONF_ISOLATE], &end, 10);
+		if (*end != '\0' || conf_isolate > 1) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_ISOLATE], conf_val[CONF_ISOLATE]);
+			ret = 1;
+			conf_isolate = DEFAULT_ISOLATE;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_ISOLATE], conf_isolate);
+		}
+		return ret;
+	}
+	if (n == CONF_DLBLOAD_ENGINE && conf_val[CONF_DLBLOAD_ENGINE]) {
+		char *end;
+		
+		conf_dlbload_engine = strtol(conf_val[CONF_DLBLOAD_ENGINE], &end, 10);
+		if (*end != '\0' || conf_dlbload_engine > 1) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_DLBLOAD_ENGINE], conf_val[CONF_DLBLOAD_ENGINE]);
+			ret = 1;
+			conf_dlbload_engine = DEFAULT_DLBLOAD_ENGINE;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_DLBLOAD_ENGINE], conf_dlbload_engine);
+		}
+		return ret;
+	}
+	if (n == CONF_ENERGY && conf_val[CONF_ENERGY]) {
+		char *end;
+		
+		conf_energy = strtol(conf_val[CONF_ENERGY], &end, 10);
+		if (*end != '\0' || conf_energy > 1) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_ENERGY], conf_val[CONF_ENERGY]);
+			ret = 1;
+			conf_energy = DEFAULT_ENERGY;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_ENERGY], conf_energy);
+		}
+		return ret;
+	}
+	if (n == CONF_SETAFFINITY && conf_val[CONF_SETAFFINITY]) {
+		char *end;
+		
+		conf_setaffinity = strtol(conf_val[CONF_SETAFFINITY], &end, 10);
+		if (*end != '\0' || conf_setaffinity >= AFF_MAX) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_SETAFFINITY], conf_val[CONF_SETAFFINITY]);
+			ret = 1;
+			conf_setaffinity = DEFAULT_SETAFFINITY;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_SETAFFINITY], conf_setaffinity);
+		}
+		return ret;
+	}
+	if (n == CONF_WATCHDOG && conf_val[CONF_WATCHDOG]) {
+		char *end;
+		
+		conf_watchdog = strtol(conf_val[CONF_WATCHDOG], &end, 10);
+		if (*end != '\0' || conf_watchdog > 100) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_WATCHDOG], conf_val[CONF_WATCHDOG]);
+			ret = 1;
+			conf_watchdog = DEFAULT_WATCHDOG;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_WATCHDOG], conf_watchdog);
+		}
+		return ret;
+	}
+	if (n == CONF_WATCHDOG_RESTART && conf_val[CONF_WATCHDOG_RESTART]) {
+		char *end;
+		
+		conf_watchdog_restart = strtol(conf_val[CONF_WATCHDOG_RESTART], &end, 10);
+		if (*end != '\0' || conf_watchdog_restart > 1) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_WATCHDOG_RESTART], conf_val[CONF_WATCHDOG_RESTART]);
+			ret = 1;
+			conf_watchdog_restart = DEFAULT_WATCHDOG_RESTART;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_WATCHDOG_RESTART], conf_watchdog_restart);
+		}
+		return ret;
+	}
+	if (n == CONF_POWER && conf_val[CONF_POWER]) {
+		char *end;
+		
+		conf_power = strtol(conf_val[CONF_POWER], &end, 10);
+		if (*end != '\0' || conf_power > 1) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_POWER], conf_val[CONF_POWER]);
+			ret = 1;
+			conf_power = DEFAULT_POWER;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_POWER], conf_power);
+		}
+		return ret;
+	}
+	if (n == CONF_POWER_LATENCY && conf_val[CONF_POWER_LATENCY]) {
+		char *end;
+		
+		conf_power_latency = strtol(conf_val[CONF_POWER_LATENCY], &end, 10);
+		if (*end != '\0' || conf_power_latency > 2000000000) {
+			llog("thekraken: configuration variable '%s': invalid value: '%s'\n", conf_key[CONF_POWER_LATENCY], conf_val[CONF_POWER_LATENCY]);
+			ret = 1;
+			conf_power_latency = DEFAULT_POWER_LATENCY;
+		} else {
+			llog("thekraken: config: %s=%d\n", conf_key[CONF_POWER_LATENCY], conf_power_latency);
+		}
+		return ret;
+	}
 
 	return 2;
 }
@@ -441,6 +909,24 @@ static int conf_line_parse(char *s)
 	memcpy(key, s, klen);
 	key[klen] = '\0';
 
+	/* may be given any number of times */
+	if (!strcmp(key, "rule")) {
+		if (rules_add(e + 1, 0)) {
+			llog("thekraken: invalid rule: '%.*s'\n", (int)strcspn(e + 1, "\r\n"), e + 1);
+			return -4;
+		}
+		return 0;
+	}
+	if (!strcmp(key, "preset")) {
+		e[1 + strcspn(e + 1, "\r\n")] = '\0';
+		if (rules_preset(e + 1)) {
+			llog("thekraken: unknown preset: '%s'\n", e + 1);
+			return -4;
+		}
+		llog("thekraken: config: preset=%s\n", e + 1);
+		return 0;
+	}
+
 	for (i = 0; conf_key[i]; i++) {
 		int len, vlen;
 		
@@ -468,7 +954,7 @@ static int conf_line_parse(char *s)
 static int conf_file_parse(char *fn)
 {
 	FILE *fp;
-	char buf[128];
+	char buf[512];
 	
 	fp = fopen(fn, "r");
 	if (!fp) {
@@ -483,12 +969,13 @@ static int conf_file_parse(char *fn)
 	return 0;
 }
 
-static void conf_create(int options)
+static void conf_create(int dfd, int options)
 {
-	FILE *fp;
+	FILE *fp = NULL;
 	struct stat st;
+	int fd;
 	
-	if (stat(".", &st)) {
+	if (fstat(dfd, &st)) {
 		return;
 	}
 	if (options & OPT_NOMODIFY) {
@@ -496,7 +983,10 @@ static void conf_create(int options)
 	}
 	setfsuid(st.st_uid); /* reasonable assumption: files, and directory they reside in are owned by the same user */
 	setfsgid(st.st_gid);
-	fp = fopen(CONF_FN, "w");
+	fd = openat(dfd, CONF_FN, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd != -1 && !(fp = fdopen(fd, "w"))) {
+		close(fd);
+	}
 	if (fp) {
 		int i;
 
@@ -510,71 +1000,84 @@ static void conf_create(int options)
 	setfsgid(getegid());
 }
 
-static void traverse(char *what, int how, int options, int *counter, int *total)
+/* 'path' is what 'what' (relative to 'parent') is called in messages */
+static void traverse(int parent, char *what, char *path, int how, int options, int *counter, int *total)
 {
 	DIR *d;
 	struct dirent *de;
 	struct stat st;
 	int answered = 0;
+	int dfd;
 	
-	if (chdir(what)) {
+	dfd = openat(parent, what, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dfd == -1) {
 		goto out;
 	}
-	debug(1) llog("thekraken: entered '%s'\n", what);
+	debug(1) llog("thekraken: entered '%s'\n", path);
 	if (!how) {
-		if (list_wrap(options, counter, total)) {
+		if (list_wrap(dfd, path, options, counter, total)) {
 			if (custom_config) {
 				/* wrapped at least one core, create config file */
 				llog("thekraken: creating configuration file\n");
-				conf_create(options);
+				conf_create(dfd, options);
 			}
 		}
 	} else {
-		if (list_unwrap(options, counter, total)) {
-			if (!stat(CONF_FN, &st)) {
+		if (list_unwrap(dfd, path, options, counter, total)) {
+			if (!fstatat(dfd, CONF_FN, &st, 0)) {
 				/* unwrapped at least one core, remove config file */
 				llog("thekraken: removing configuration file\n");
 				if ((options & OPT_NOMODIFY) == 0) {
-					unlink(CONF_FN);
+					unlinkat(dfd, CONF_FN, 0);
 				}
 			}
+			if ((options & OPT_NOMODIFY) == 0) {
+				unlinkat(dfd, PLAN_FN, 0);
+			}
 		}
 	}
-	d = opendir(".");
+	d = fdopendir(dfd);
 	if (!d) {
+		close(dfd);
 		goto out_up;
 	}
 	while ((de = readdir(d))) {
+		char sub[PATH_MAX];
+
 		if (!strcmp(de->d_name, "."))
 			continue;
 		if (!strcmp(de->d_name, ".."))
 			continue;
 		if (!strcmp(de->d_name, "work"))
 			continue;
-		if (stat(de->d_name, &st))
-			continue;
-		if (!S_ISDIR(st.st_mode))
-			continue;
+		if (de->d_type != DT_DIR) {
+			/* symlinks are followed; some filesystems don't fill d_type */
+			if (de->d_type != DT_LNK && de->d_type != DT_UNKNOWN)
+				continue;
+			if (fstatat(dfd, de->d_name, &st, 0))
+				continue;
+			if (!S_ISDIR(st.st_mode))
+				continue;
+		}
+		snprintf(sub, sizeof(sub), "%s/%s", path, de->d_name);
 		if (!answered && (options & OPT_YES) == 0) {
-			char *wd = k_getwd();
 			int c;
 
 			if (isatty(0)) {
-				llog("thekraken: descend into '%s/%s' and all other subdirectories [Y/n]? ", wd, de->d_name);
+				llog("thekraken: descend into '%s' and all other subdirectories [Y/n]? ", sub);
 				if ((c = getchar()) == 'y' || c == 'Y' || c == '\n')
 					options |= OPT_YES;
 			} else {
-				llog("thekraken: standard input is not a terminal, not descending into '%s/%s' or any other subdirectories\n", wd, de->d_name);
+				llog("thekraken: standard input is not a terminal, not descending into '%s' or any other subdirectories\n", sub);
 			}
 			answered = 1;
 		}
 		if (options & OPT_YES)
-			traverse(de->d_name, how, options, counter, total);
+			traverse(dfd, de->d_name, sub, how, options, counter, total);
 	}
 	closedir(d);
 out_up:
-	debug(1) llog("thekraken: leaving '%s'\n", what);
-	chdir("..");
+	debug(1) llog("thekraken: leaving '%s'\n", path);
 out:
 	return;
 }
@@ -613,45 +1116,573 @@ static void getstr(pid_t child, long addr, int len, char *dst, int *dstofs, int
 	*dstofs = curstr - dst;
 }
 
-int main(int ac, char **av)
+/*
+ * Detaches from all known FahCore threads (observation mode); 'stopped'
+ * is a thread currently in ptrace-stop, 0 if none. Every thread is made
+ * to stop with SIGSTOP which then gets suppressed by PTRACE_DETACH.
+ */
+static void detach_all(pid_t stopped)
 {
-	char nbin[PATH_MAX];
-	char *s, *t = nbin;
-	int len = 0;
-	char config[PATH_MAX];
-	char *u = config;
-	
-	int status;
-
-	int nclones = -1;
-	int last_used_cpu = 0;
-	cpu_set_t cpuset;
+	int i, n = 0;
 
-	pid_t tpid = 0; /* traced (syscall) thread PID */
-	pid_t mpid = 0; /* load manager PID */
-
-#define FAHCORE_BUF_SIZE 128
-	int fahcore_logfd = -1;
+	for (i = 0; i < task_count(); i++) {
+		pid_t tid = task_at(i)->tid;
+		int status;
 
-	/* setup the buffer to store data written to logfile_xx.txt and stderr */
-	char fahcore_logbuf[FAHCORE_BUF_SIZE];
-	int fahcore_logbufpos = 0;
-	char fahcore_errbuf[FAHCORE_BUF_SIZE];
-	int fahcore_errbufpos = 0;
+		syscall(SYS_tgkill, cpid, tid, SIGSTOP);
+		if (tid == stopped) {
+			ptrace(PTRACE_CONT, tid, 0, 0);
+		}
+		while (waitpid(tid, &status, __WALL) == tid) {
+			if (!WIFSTOPPED(status))
+				break;
+			if (WSTOPSIG(status) == SIGSTOP && (status >> 16) == 0) {
+				if (ptrace(PTRACE_DETACH, tid, 0, 0) == 0)
+					n++;
+				break;
+			}
+			/* some other stop; let it go until our SIGSTOP arrives */
+			ptrace(PTRACE_CONT, tid, 0, WSTOPSIG(status) == SIGTRAP ? 0 : WSTOPSIG(status));
+		}
+	}
+	/* SIGSTOP above initiated group stop which outlives the detach */
+	kill(cpid, SIGCONT);
+	llog("thekraken: %d: detached from %d thread(s); FahCore runs untraced\n", stopped ? stopped : cpid, n);
+}
 
-	int tpid_insyscall = 0;
-	int cpid_insyscall = 0;
-	
+/*
+ * Binds FahCore thread 'c' (clone number 'clone', created by 'rv') the way
+ * its role calls for: master and ranks take the cpu of the lowest free
+ * slot of 'order' (slots of exited threads get reused before untouched ones),
+ * helpers go to efficiency cores (if any) and the rest is left unbound.
+ * Applies scheduling policy and adds the thread to the task table.
+ * Returns role.
+ */
+static int place_thread(pid_t rv, pid_t c, int clone, const int *order, int norder)
+{
+	static int overflow; /* ran out of slots before */
+	int slot = -1, cpu = -1;
+	int role;
+
+	if (clone != 2 && clone != 3) {
+		slot = task_slot_alloc();
+		if (slot < 0 && !overflow) {
+			llog("thekraken: %d: more threads than usable cpus (%d usable, starting with cpu %d); %d and subsequent threads left unbound\n", rv, topo_nr_usable(), conf_startcpu, c);
+			overflow = 1;
+		} else if (slot < 0) {
+			llog("thekraken: %d: %d left unbound\n", rv, c);
+		} else {
+			cpu = order[slot];
+			llog("thekraken: %d: binding %d to cpu %d\n", rv, c, cpu);
+			if (topo_bind(c, cpu)) {
+				llog("thekraken: %d: binding %d to cpu %d failed: %s\n", rv, c, cpu, strerror(errno));
+				cpu = -1;
+			}
+		}
+	} else if (topo_nr_classes() > 1) {
+		/* helpers mostly sleep; keep them off the performance cores */
+		llog("thekraken: %d: binding helper %d to efficiency cores\n", rv, c);
+		if (topo_bind_class(c, topo_nr_classes() - 1)) {
+			llog("thekraken: %d: binding %d to efficiency cores failed: %s\n", rv, c, strerror(errno));
+		}
+	}
+	if (clone == 1) {
+		role = ROLE_MASTER;
+	} else if (clone == 2 || clone == 3) {
+		role = ROLE_HELPER;
+	} else {
+		role = ROLE_RANK;
+	}
+	if (role == ROLE_MASTER && !policy_defined(ROLE_MASTER)) {
+		policy_apply(ROLE_RANK, c);
+	} else {
+		policy_apply(role, c);
+	}
+	task_add(c, role, clone, slot, cpu);
+	return role;
+}
+
+/* forgets FahCore thread 'tid' that exited; its cpu is up for grabs */
+static void clone_gone(pid_t tid)
+{
+	struct task *t = task_find(tid);
+
+	if (t && t->slot >= 0) {
+		llog("thekraken: %d: thread exited; cpu %d (slot %d) freed\n", tid, t->cpu, t->slot);
+	} else {
+		llog("thekraken: %d: ignoring clone exit\n", tid);
+	}
+	task_remove(tid);
+}
+
+static pid_t synthload_spawn(pid_t rv, int workers, const int *cpus, int ncpus)
+{
+	pid_t pid;
+
+	llog("thekraken: %d: creating %d synthload workers: on %dms, off %dms, deadline %dms\n", rv, workers, conf_dlbload_onperiod, conf_dlbload_offperiod, conf_dlbload_deadline);
+	pid = synthload_start(conf_dlbload_onperiod, conf_dlbload_offperiod, conf_dlbload_deadline, workers, cpus, ncpus);
+	if (pid < 0) {
+		llog("thekraken: %d: synthload_start failed: %s (rv: %d)\n", rv, strerror(errno), pid);
+	}
+	llog("thekraken: %d: synthload manager created (%d)\n", rv, pid);
+	return pid;
+}
+
+/*
+ * dlbload_engine=1 counterpart of synthload_spawn(): throttles ranks on
+ * the cpus synthload workers would go to (every other slot). Returns 0 on
+ * success.
+ */
+static int throttle_spawn(pid_t rv, int workers)
+{
+	pid_t tids[TASK_MAX];
+	int n = 0, i;
+
+	for (i = 0; i < task_count() && n < workers; i++) {
+		if (task_at(i)->slot % 2 == 1)
+			tids[n++] = task_at(i)->tid;
+	}
+	llog("thekraken: %d: throttling %d rank(s): on %dms, off %dms, deadline %dms\n", rv, n, conf_dlbload_onperiod, conf_dlbload_offperiod, conf_dlbload_deadline);
+	if (throttle_start(conf_dlbload_onperiod, conf_dlbload_offperiod, conf_dlbload_deadline, cpid, tids, n) == -1) {
+		llog("thekraken: %d: throttle_start failed: %s\n", rv, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* starts the DLB trigger engine configured; returns synthload manager PID, 0 if throttling, < 0 on error */
+static pid_t dlbload_spawn(pid_t rv, int workers, const int *cpus, int ncpus, int traced)
+{
+	if (conf_dlbload_engine == 1 && traced) {
+		return throttle_spawn(rv, workers);
+	}
+	return synthload_spawn(rv, workers, cpus, ncpus);
+}
+
+/*
+ * Live counterpart of conf_line_parse(); 's' is validated the same way
+ * but current value is kept if it's invalid. Returns CONF_* index of the
+ * variable set, -1 on error.
+ */
+static int conf_set(char *s)
+{
+	char *e = strchr(s, '=');
+	char *old;
+	unsigned int cur = 0;
+	int i;
+
+	if (!e) {
+		return -1;
+	}
+	for (i = 0; conf_key[i]; i++) {
+		if (strlen(conf_key[i]) == e - s && !strncmp(conf_key[i], s, e - s))
+			break;
+	}
+	if (!conf_key[i]) {
+		return -1;
+	}
+	old = conf_val[i];
+	conf_val[i] = NULL;
+	/* the value in effect may come from a default or the autotuner, not from conf_val */
+	if (conf_var[i])
+		cur = *conf_var[i];
+	if (conf_line_parse(s)) {
+		free(conf_val[i]);
+		conf_val[i] = old;
+		if (conf_var[i])
+			*conf_var[i] = cur;
+		return -1;
+	}
+	free(old);
+	return i;
+}
+
+/*
+ * Re-binds FahCore threads bound so far following 'policy' (every thread
+ * keeps its slot); refills 'order' and returns number of cpus in it.
+ */
+static int repin(int policy, int *order)
+{
+	struct task *t;
+	int n, nbound = 0, i;
+
+	n = place_order(policy, conf_startcpu, order);
+	for (i = 0; i < task_count(); i++) {
+		if (task_at(i)->slot >= 0)
+			nbound++;
+	}
+	llog("thekraken: switching to %s placement (%d bound thread(s))\n", place_name(policy), nbound);
+	for (i = 0; i < task_count(); i++) {
+		t = task_at(i);
+		if (t->slot < 0 || t->slot >= n || t->cpu == order[t->slot])
+			continue;
+		if (topo_bind(t->tid, order[t->slot])) {
+			llog("thekraken: binding %d to cpu %d failed: %s\n", t->tid, order[t->slot], strerror(errno));
+			continue;
+		}
+		debug(1) llog("thekraken: %d: cpu %d -> cpu %d\n", t->tid, t->cpu, order[t->slot]);
+		t->cpu = order[t->slot];
+	}
+	return n;
+}
+
+/*
+ * Moves IRQs and unbound workqueues off the cpus the first 'nthreads'
+ * entries of 'order' (master and ranks) are bound to (isolate=1); needs
+ * root unless working on a snapshot.
+ */
+static void isolate(const int *order, int norder, int nthreads)
+{
+	size_t size = CPU_ALLOC_SIZE(topo_nr_cpus());
+	cpu_set_t *house = CPU_ALLOC(topo_nr_cpus());
+	char list[256];
+	int i, moved, refused, wqs;
+
+	if (geteuid() != 0 && !topo_root()[0]) {
+		llog("thekraken: isolate: moving IRQs needs root; skipped\n");
+		CPU_FREE(house);
+		return;
+	}
+	/* online cpus the admin hasn't set aside (isolcpus, nohz_full) */
+	CPU_ZERO_S(size, house);
+	for (i = 0; i < topo_nr_cpus(); i++) {
+		if (topo_cpu_online(i) && !topo_cpu_isolated(i))
+			CPU_SET_S(i, size, house);
+	}
+	for (i = 0; i < nthreads && i < norder; i++) {
+		CPU_CLR_S(order[i], size, house);
+	}
+	if (CPU_COUNT_S(size, house) == 0) {
+		llog("thekraken: isolate: no housekeeping cpus left; IRQs left alone\n");
+		CPU_FREE(house);
+		return;
+	}
+	moved = irqaff_isolate(house, size, &refused, &wqs);
+	if (moved < 0) {
+		llog("thekraken: isolate: another wrapper has IRQs moved; skipped\n");
+		CPU_FREE(house);
+		return;
+	}
+	llog("thekraken: isolate: %d IRQ(s) moved to cpus %s (%d refused), %d workqueue mask(s) set\n", moved, topo_format_cpulist(house, size, list, sizeof(list)), refused, wqs);
+	CPU_FREE(house);
+}
+
+static void isolate_restore(void)
+{
+	int n = irqaff_restore();
+
+	if (n) {
+		llog("thekraken: isolate: %d IRQ/workqueue setting(s) restored\n", n);
+	}
+}
+
+/*
+ * Sets cpufreq of the cpus the first 'nthreads' entries of 'order' (master
+ * and ranks) are bound to to performance and holds a PM QoS request for
+ * the rest of the WU (power=1); needs root unless working on a snapshot.
+ */
+static void power_set(const int *order, int norder, int nthreads)
+{
+	int n, epp;
+
+	if (geteuid() != 0 && !topo_root()[0]) {
+		llog("thekraken: power: changing cpufreq settings and PM QoS needs root; skipped\n");
+		return;
+	}
+	n = power_apply(order, nthreads < norder ? nthreads : norder, &epp);
+	llog("thekraken: power: %d cpu(s) set to performance (%d through energy performance preference)\n", n, epp);
+	if (power_qos(conf_power_latency)) {
+		llog("thekraken: power: cannot request %dus cpu wake-up latency: %s\n", conf_power_latency, strerror(errno));
+	} else {
+		llog("thekraken: power: requested %dus cpu wake-up latency\n", conf_power_latency);
+	}
+}
+
+static void power_unset(void)
+{
+	int n = power_restore();
+
+	if (n) {
+		llog("thekraken: power: %d cpufreq setting(s) restored\n", n);
+	}
+}
+
+#define PLAN_RUNS 1000
+
+/*
+ * Prints cpu and memory plan for 'nthreads' compute threads (all usable
+ * cpus if 0) under every placement policy along with time it takes to
+ * compute the plan.
+ */
+static void plan_dryrun(int nthreads)
+{
+	int *order = malloc(topo_nr_cpus() * sizeof(*order));
+	int policy, i, r, n = 0;
+
+	if (conf_isolate) {
+		topo_use_isolated();
+	}
+	llog("thekraken: topology %s: %d usable cpu(s) (%d possible), %d node(s), %d core class(es)\n", topo_root()[0] ? topo_root() : "/", topo_nr_usable(), topo_nr_cpus(), topo_nr_nodes(), topo_nr_classes());
+	for (policy = 0; policy < PLACE_MAX; policy++) {
+		struct timespec t0, t1;
+		double us;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (r = 0; r < PLAN_RUNS; r++) {
+			n = place_order(policy, conf_startcpu, order);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		us = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / 1e3 / PLAN_RUNS;
+		llog("thekraken: plan: %s: %d cpu(s), computed in %.1f us (average of %d runs)\n", place_name(policy), n, us, PLAN_RUNS);
+		for (i = 0; i < (nthreads ? nthreads : n); i++) {
+			if (i < n) {
+				llog("thekraken: plan: %s: thread %d: cpu %d, memory node %d (llc %d, core %d, class %d, capacity %d)\n", place_name(policy), i, order[i], topo_cpu_node(order[i]), topo_cpu_llc(order[i]), topo_cpu_core(order[i]), topo_cpu_class(order[i]), topo_cpu_capacity(order[i]));
+			} else {
+				llog("thekraken: plan: %s: thread %d: unbound\n", place_name(policy), i);
+			}
+		}
+	}
+	if (conf_isolate && topo_root()[0]) {
+		/* a snapshot can take it */
+		n = place_order(conf_placement, conf_startcpu, order);
+		isolate(order, n, nthreads ? nthreads : n);
+		llog("thekraken: isolate: %d setting(s) restored\n", irqaff_restore());
+	}
+	free(order);
+}
+
+#define REPLAY_RUNS 100
+/*
+ * Feeds recording 'fn' (see record.c) through logfile detection and log
+ * scanning the way the tracing loop does, printing what gets detected,
+ * then times it (average of REPLAY_RUNS runs).
+ */
+static int replay(const char *fn)
+{
+	const char *buf;
+	size_t size, pos;
+	const struct rec_hdr *h;
+	struct timespec t0, t1;
+	long events = 0, bytes = 0;
+	double us;
+	int r;
+
+	buf = record_load(fn, &size);
+	if (!buf) {
+		llog("thekraken: cannot load recording '%s'\n", fn);
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (r = 0; r < REPLAY_RUNS; r++) {
+		struct logscan logscan, errscan;
+		int fahcore_logfd = -1, found = 0, dlb = 0;
+		char slot[4] = "";
+
+		logscan_init(&logscan, "log");
+		logscan_init(&errscan, "stderr");
+		pos = 0;
+		while ((h = record_next(buf, size, &pos))) {
+			char path[64];
+			int ev = 0;
+
+			if (h->type == REC_CLONE) {
+				if (!r)
+					llog("thekraken: replay: %u.%03us: clone %d\n", h->ms / 1000, h->ms % 1000, h->fd);
+			} else if (h->type == REC_OPEN && fahcore_logfd == -1) {
+				snprintf(path, sizeof(path), "%.*s", (int)h->len, REC_DATA(h));
+				if (logscan_logfile(path, slot)) {
+					fahcore_logfd = h->fd;
+					if (!r)
+						llog("thekraken: replay: %u.%03us: logfile fd: %d (pathname: %s, slot %s)\n", h->ms / 1000, h->ms % 1000, fahcore_logfd, path, slot);
+				}
+			} else if (h->type == REC_WRITE && (h->fd == fahcore_logfd || h->fd == STDERR_FILENO)) {
+				ev = logscan_feed(h->fd == STDERR_FILENO ? &errscan : &logscan, REC_DATA(h), h->len);
+			}
+			if (!r) {
+				if (ev & LOGSCAN_FIRST_STEP && !found++)
+					llog("thekraken: replay: %u.%03us: first step identified\n", h->ms / 1000, h->ms % 1000);
+				if (ev & LOGSCAN_DLB && !dlb++)
+					llog("thekraken: replay: %u.%03us: DLB has engaged\n", h->ms / 1000, h->ms % 1000);
+				events++;
+				bytes += h->len;
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	us = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / 1e3 / REPLAY_RUNS;
+	llog("thekraken: replay: %ld event(s), %ld bytes, replayed in %.1f us (average of %d runs, %.1f MB/s)\n", events, bytes, us, REPLAY_RUNS, us > 0 ? bytes / us : 0);
+	return 0;
+}
+
+/*
+ * Attaches to FahCore 'pid' started without the wrapper: binds its threads
+ * as if it had been wrapped and starts NUMA migration and THP jobs (if
+ * configured). Then detaches or, with 'keep', stays around to bind threads
+ * created later until FahCore exits; should we get killed meanwhile, the
+ * kernel detaches for us.
+ */
+static int attach(pid_t pid, int keep)
+{
+	pid_t *tids = malloc(TASK_MAX * sizeof(*tids));
+	int *order = malloc(topo_nr_cpus() * sizeof(*order));
+	int norder, n, i, nclones, status;
+	pid_t rv;
+
+	norder = place_order(conf_placement, conf_startcpu, order);
+	llog("thekraken: %s placement across %d cpu(s) starting with cpu %d\n", place_name(conf_placement), norder, conf_startcpu);
+	task_slots_init(norder);
+
+	n = attach_seize(pid, tids, TASK_MAX);
+	if (n < 0) {
+		llog("thekraken: cannot attach to %d: %s\n", pid, strerror(errno));
+		return -1;
+	}
+	llog("thekraken: %d: seized %d thread(s)\n", pid, n);
+	policy_apply(ROLE_MAIN, pid);
+	task_add(pid, ROLE_MAIN, 0, -1, -1);
+	for (i = 1; i < n; i++) {
+		place_thread(pid, tids[i], i, order, norder);
+	}
+	nclones = n - 1;
+
+	if (conf_numamig) {
+		rv = numamig_start(pid, conf_numamig_interval, conf_numamig_rate, !keep);
+		if (rv < 0) {
+			llog("thekraken: %d: numamig_start failed: %s\n", pid, strerror(errno));
+		} else {
+			llog("thekraken: %d: NUMA migration job created (%d): every %ds, up to %d pages/s\n", pid, rv, conf_numamig_interval, conf_numamig_rate);
+		}
+	}
+	if (conf_thp) {
+		rv = thp_start(pid, conf_thp_minsize, conf_thp_chunk, conf_thp_interval, !keep);
+		if (rv < 0) {
+			llog("thekraken: %d: thp_start failed: %s\n", pid, strerror(errno));
+		} else {
+			llog("thekraken: %d: THP collapse job created (%d): mappings >= %dMB, %dMB pieces every %dms\n", pid, rv, conf_thp_minsize, conf_thp_chunk, conf_thp_interval);
+		}
+	}
+
+	if (!keep) {
+		llog("thekraken: %d: detached from %d thread(s)\n", pid, attach_release(tids, n));
+		return 0;
+	}
+	attach_resume(tids, n, PTRACE_O_TRACECLONE);
+	llog("thekraken: %d: supervising; threads created from now on get bound as well\n", pid);
+	while ((rv = waitpid(-1, &status, __WALL)) > 0) {
+		int e = status >> 16;
+
+		if (WIFEXITED(status) || WIFSIGNALED(status)) {
+			if (rv == pid) {
+				llog("thekraken: %d: FahCore exited\n", pid);
+				break;
+			}
+			task_remove(rv);
+			continue;
+		}
+		if (!WIFSTOPPED(status)) {
+			continue;
+		}
+		if (e == PTRACE_EVENT_CLONE) {
+			unsigned long c;
+
+			ptrace(PTRACE_GETEVENTMSG, rv, 0, &c);
+			llog("thekraken: %d: cloned %d\n", rv, (int)c);
+			place_thread(rv, c, ++nclones, order, norder);
+			ptrace(PTRACE_CONT, rv, 0, 0);
+		} else if (e == PTRACE_EVENT_STOP) {
+			int sig = WSTOPSIG(status);
+
+			/* new thread starting or group stop (which is to be kept) */
+			if (sig == SIGSTOP || sig == SIGTSTP || sig == SIGTTIN || sig == SIGTTOU) {
+				ptrace(PTRACE_LISTEN, rv, 0, 0);
+			} else {
+				ptrace(PTRACE_CONT, rv, 0, 0);
+			}
+		} else {
+			ptrace(PTRACE_CONT, rv, 0, e ? 0 : WSTOPSIG(status));
+		}
+	}
+	return 0;
+}
+
+/*
+ * Child to parent report once seccomp filters are in: write() and friends
+ * get SECCOMP_RET_TRACE then and fail with ENOSYS until the tracer sets
+ * PTRACE_O_TRACESECCOMP after exec, while send() isn't filtered.
+ */
+static void child_report(int fd, const char *fmt, ...)
+{
+	char buf[STR_BUF_SIZE];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	send(fd, buf, strlen(buf), MSG_NOSIGNAL);
+}
+
+int main(int ac, char **av)
+{
+	char nbin[PATH_MAX];
+	char *s, *t = nbin;
+	int len = 0;
+	char config[PATH_MAX];
+	char *u = config;
+	char planfn[PATH_MAX];
+	
+	int status;
+
+	int nclones = -1;
+	int *cpu_order; /* cpus to bind FahCore threads to, in order */
+	int cpu_norder;
+
+	pid_t tpid = 0; /* traced (syscall) thread PID */
+	pid_t mpid = 0; /* load manager PID */
+	pid_t npid = 0; /* NUMA migration job PID */
+	pid_t hpid = 0; /* THP collapse job PID */
+	pid_t wpid = 0; /* warm-up job PID */
+	struct warmup warm;
+
+	int fahcore_logfd = -1;
+	int find_logfd = 1; /* cpid is syscall-traced until logfile fd is known */
+
+	/* scanners of data written to logfile_xx.txt and stderr */
+	struct logscan logscan, errscan;
+	int events = 0; /* LOGSCAN_* events pending */
+	pid_t evpid = 0; /* thread which reported them */
+
+	struct pollfd pfd[7];
+	int sigfd, errfd_eof = 0, wait_pending = 1;
+	int repfd[2]; /* child's reports until exec */
+	sigset_t sigchld;
+	int expected_clones = 0; /* all threads FahCore is going to create (observation mode) */
+	int detached = 0;
+
+	int tpid_insyscall = 0;
+	int cpid_insyscall = 0;
+	int quiet;
+	
 	time_t synthload_start_time = 0;
 
 	int shutdown = 0;
 
 	int first_step = 0;
+	time_t first_step_time = 0;
 
 	char fah_slot[4] = { '\0', };
 
+	/* for the ledger */
+	char *core;
+	char **core_av, **core_env;
+	int np = 0;
+	int project = -1;
+	int dlb_time = -1; /* seconds from first step to DLB engagement */
+	struct ledger_conf lconf;
+
 	logfp = stderr;
 
+	topo_init();
+
 	s = strrchr(av[0], '/');
 	if (!s) {
 		s = av[0];
@@ -661,7 +1692,11 @@ int main(int ac, char **av)
 	
 	if (strstr(s, "thekraken")) {
 		int c; 
-		int opt_wrap = 0, opt_unwrap = 0, opt_help = 0, opt_yes = 0, opt_version = 0, opt_nomodify = 0;
+		int opt_wrap = 0, opt_unwrap = 0, opt_help = 0, opt_yes = 0, opt_version = 0, opt_nomodify = 0, opt_plan = 0, opt_ctl = 0, opt_attach = 0, opt_keep = 0, opt_replay = 0;
+		char *attach_arg = NULL;
+		char *replay_fn = NULL;
+		int plan_threads = 0;
+		char *ctl_path = NULL;
 		char *path = NULL;
 		int counter = 0, total = 0;
 		int rv;
@@ -670,7 +1705,7 @@ int main(int ac, char **av)
 		llog(WELCOME_LINE2);
 		llog(WELCOME_LINE3);
 		opterr = 0;
-		while ((c = getopt(ac, av, "+wiuhyvnVc:")) != -1) {
+		while ((c = getopt(ac, av, "+wiuhyvnVkc:r:P:C:a:R:")) != -1) {
 			switch (c) {
 				case 'i':
 				case 'w':
@@ -694,6 +1729,29 @@ int main(int ac, char **av)
 				case 'n':
 					opt_nomodify = 1;
 					break;
+				case 'r':
+					topo_set_root(optarg);
+					topo_init();
+					break;
+				case 'P':
+					opt_plan = 1;
+					plan_threads = atoi(optarg);
+					break;
+				case 'C':
+					opt_ctl = 1;
+					ctl_path = optarg;
+					break;
+				case 'a':
+					opt_attach = 1;
+					attach_arg = optarg;
+					break;
+				case 'k':
+					opt_keep = 1;
+					break;
+				case 'R':
+					opt_replay = 1;
+					replay_fn = optarg;
+					break;
 				case 'c':
 					custom_config = 1;
 					conf_line_add(av[optind - 1]);
@@ -711,7 +1769,7 @@ int main(int ac, char **av)
 						return -1;
 					break;
 				case '?':
-					if (optopt != 'c')
+					if (optopt != 'c' && optopt != 'r' && optopt != 'P' && optopt != 'C' && optopt != 'a' && optopt != 'R')
 						llog("thekraken: ERROR: option not recognized: -%c\n", optopt);
 					else
 						llog("thekraken: ERROR: option '-%c' requires an argument\n", optopt);
@@ -722,14 +1780,23 @@ int main(int ac, char **av)
 			}
 		}
 
-		rv = opt_wrap + opt_unwrap + opt_help + opt_version;
+		rv = opt_wrap + opt_unwrap + opt_help + opt_version + opt_plan + opt_ctl + opt_attach + opt_replay;
 		if (rv > 1) {
-			llog("thekraken: ERROR: choose either of '-w', '-u', '-h' or '-V'\n");
+			llog("thekraken: ERROR: choose either of '-w', '-u', '-a', '-P', '-R', '-C', '-h' or '-V'\n");
 			return -1;
 		}
 		if (rv == 0) {
 			opt_help = 1;
 		}
+		if (opt_ctl) {
+			char cmd[CTL_CMD_SIZE] = "";
+			int k;
+
+			for (k = optind; k < ac; k++) {
+				snprintf(cmd + strlen(cmd), sizeof(cmd) - strlen(cmd), "%s%s", k > optind ? " " : "", av[k]);
+			}
+			return ctl_send(ctl_path, cmd) ? -1 : 0;
+		}
 		if (opt_wrap || opt_unwrap) {
 			if (optind + 1 < ac) {
 				llog("thekraken: ERROR: parameter '%s' not recognized\n", av[optind + 1]);
@@ -744,10 +1811,28 @@ int main(int ac, char **av)
 		if (opt_version == 1) {
 			return 0;
 		}
+		if (opt_plan == 1) {
+			plan_dryrun(plan_threads);
+			return 0;
+		}
+		if (opt_replay == 1) {
+			return replay(replay_fn) ? -1 : 0;
+		}
+		if (opt_attach == 1) {
+			if (atoi(attach_arg) <= 0) {
+				llog("thekraken: ERROR: invalid PID: '%s'\n", attach_arg);
+				return -1;
+			}
+			return attach(atoi(attach_arg), opt_keep) ? -1 : 0;
+		}
 		if (opt_help == 1) {
 			llog("Usage:\n");
 			llog("\t%s [-v] [-y] [-n] [-c opt1=val1] [-c opt2=val2] [...] -i [path]\n", av[0]);
 			llog("\t%s [-v] [-y] [-n] -u [path]\n", av[0]);
+			llog("\t%s [-r root] [-c startcpu=N] -P threads\n", av[0]);
+			llog("\t%s [-c opt1=val1] [...] [-k] -a pid\n", av[0]);
+			llog("\t%s -R recording\n", av[0]);
+			llog("\t%s -C socket command\n", av[0]);
 			llog("\t%s -h\n", av[0]);
 			llog("\t%s -V\n", av[0]);
 			llog("\n");
@@ -763,6 +1848,21 @@ int main(int ac, char **av)
 			llog("\t-n\t\tno modify mode\n");
 			llog("\t-c opt=val\tcreate configuration file with 'opt' variable\n");
 			llog("\t\t\tset to 'val'; can be specified multiple times\n");
+			llog("\t-P threads\tprint cpu and memory plan for 'threads' compute\n");
+			llog("\t\t\tthreads (0: all usable cpus) under every placement\n");
+			llog("\t\t\tpolicy and exit\n");
+			llog("\t-r root\t\tread topology from sysfs snapshot under 'root'\n");
+			llog("\t\t\tdirectory (e.g. generated by topologies/mktopo)\n");
+			llog("\t-a pid\t\tbind threads of FahCore 'pid' that was started\n");
+			llog("\t\t\tunwrapped (placement, scheduling, numamig, thp\n");
+			llog("\t\t\tas set with '-c') and detach\n");
+			llog("\t-k\t\twith '-a': stay attached and bind threads FahCore\n");
+			llog("\t\t\tcreates later, until it exits\n");
+			llog("\t-R file\t\treplay recording (made with '-c record=1') through\n");
+			llog("\t\t\tlog scanner, print what's detected and time it\n");
+			llog("\t-C socket\tsend 'command' to running wrapper listening on\n");
+			llog("\t\t\t'socket' (thekraken-PID.sock in client directory)\n");
+			llog("\t\t\tand print its reply; 'help' lists commands\n");
 			llog("\t-V\t\tprint version information and exit\n");
 			llog("\t-h\t\tdisplay this help and exit\n");
 			return 0;
@@ -775,7 +1875,7 @@ int main(int ac, char **av)
 		}
 		if (opt_wrap) {
 			llog("thekraken: wrapping FahCores in '%s'\n", path);
-			traverse(path, 0, (opt_yes ? OPT_YES : 0) | (opt_nomodify ? OPT_NOMODIFY : 0), &counter, &total);
+			traverse(AT_FDCWD, path, realpath(path, wdbuf) ? wdbuf : path, 0, (opt_yes ? OPT_YES : 0) | (opt_nomodify ? OPT_NOMODIFY : 0), &counter, &total);
 			if (total == 0) {
 				llog("thekraken: finished, found no files to process\n");
 			} else {
@@ -785,7 +1885,7 @@ int main(int ac, char **av)
 		}
 		if (opt_unwrap) {
 			llog("thekraken: unwrapping FahCores in '%s'\n", path);
-			traverse(path, 1, (opt_yes ? OPT_YES : 0) | (opt_nomodify ? OPT_NOMODIFY : 0), &counter, &total);
+			traverse(AT_FDCWD, path, realpath(path, wdbuf) ? wdbuf : path, 1, (opt_yes ? OPT_YES : 0) | (opt_nomodify ? OPT_NOMODIFY : 0), &counter, &total);
 			if (total == 0) {
 				llog("thekraken: finished, found no files to process\n");
 			} else {
@@ -833,25 +1933,142 @@ int main(int ac, char **av)
 	nbin[sizeof(nbin) - 1] = '\0';
 	snprintf(t, sizeof(nbin) - len - 1, INSTALL_FMT, s);
 	llog("thekraken: launch binary: %s\n", nbin);
+	core = s;
 
 	u += len;
 	config[sizeof(config) - 1] = '\0';
 	snprintf(u, sizeof(config) - len - 1, "%s", CONF_FN);
+	snprintf(planfn, sizeof(planfn), "%.*s%s", len, config, PLAN_FN);
 	llog("thekraken: config file: %s\n", config);
 
 	conf_file_parse(config);
 	
 	debug_level += conf_v;
 
+	llog("thekraken: %d usable cpu(s) (%d possible), %d node(s)\n", topo_nr_usable(), topo_nr_cpus(), topo_nr_nodes());
+
 	signal(SIGHUP, sighandler);
 	signal(SIGTERM, sighandler);
 	signal(SIGINT, sighandler);
 	signal(SIGTSTP, sighandler);
 	signal(SIGALRM, sigalrmhandler);
 
-	/* set the last_used_cpu to the config setting (default: 0) */
-	last_used_cpu = conf_startcpu;
+	if (conf_observe) {
+		if (conf_commaff || conf_iostat || conf_setaffinity) {
+			llog("thekraken: commaff, iostat and setaffinity need syscall tracing; disabled in observation mode\n");
+			conf_commaff = conf_iostat = conf_setaffinity = 0;
+		}
+		if (observe_init()) {
+			llog("thekraken: observation mode unavailable: %s; tracing syscalls instead\n", strerror(errno));
+			conf_observe = 0;
+		}
+	}
+	find_logfd = !conf_observe;
+	logscan_init(&logscan, "log");
+	logscan_init(&errscan, "stderr");
 
+	/* SIGCHLD is consumed through signalfd; children unblock it */
+	sigemptyset(&sigchld);
+	sigaddset(&sigchld, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &sigchld, NULL);
+
+	if (conf_isolate) {
+		int k = topo_use_isolated();
+
+		if (k > 0) {
+			llog("thekraken: isolate: %d isolated cpu(s) made usable\n", k);
+		}
+	}
+
+	/* FahCore's argv and environment as rewritten by rules; -np N: N ranks, master and two helpers */
+	{
+		struct rule_ctx ctx;
+		int k;
+
+		ctx.core = core;
+		ctx.cpus = 0;
+		for (k = topo_next_usable(conf_startcpu); k >= 0; k = topo_next_usable(k + 1)) {
+			ctx.cpus++;
+		}
+		ctx.nodes = topo_nr_nodes();
+		if (conf_remap_np) {
+			rules_add(REMAP_NP_RULE, 1);
+		}
+		np = rules_apply(ac, av, &ctx, &core_av, &core_env);
+		expected_clones = np ? np + 2 : 0;
+	}
+
+	/* usable cpus starting with the config setting (default: 0) in placement policy order */
+	cpu_order = malloc(topo_nr_cpus() * sizeof(*cpu_order));
+	{
+		uint64_t key = plan_key(conf_placement, conf_startcpu, conf_isolate, core, np);
+
+		cpu_norder = plan_load(planfn, key, cpu_order);
+		if (cpu_norder >= 0) {
+			llog("thekraken: placement plan loaded from %s\n", planfn);
+		} else {
+			cpu_norder = place_order(conf_placement, conf_startcpu, cpu_order);
+			if (plan_save(planfn, key, cpu_order, cpu_norder)) {
+				llog("thekraken: cannot save placement plan to %s: %s\n", planfn, strerror(errno));
+			}
+		}
+	}
+	llog("thekraken: %s placement across %d cpu(s) starting with cpu %d\n", place_name(conf_placement), cpu_norder, conf_startcpu);
+	task_slots_init(cpu_norder);
+	if (conf_isolate) {
+		isolate(cpu_order, cpu_norder, np ? np + 1 : cpu_norder);
+		atexit(isolate_restore);
+	}
+	if (conf_power) {
+		power_set(cpu_order, cpu_norder, np ? np + 1 : cpu_norder);
+		atexit(power_unset);
+	}
+
+	lconf.placement = conf_placement;
+	lconf.onperiod = conf_dlbload_onperiod;
+	lconf.offperiod = conf_dlbload_offperiod;
+
+	if (conf_commaff) {
+		commaff_init(conf_commaff_period);
+	}
+	if (conf_record) {
+		if (record_open(RECORD_FN)) {
+			llog("thekraken: cannot record to " RECORD_FN ": %s\n", strerror(errno));
+		} else {
+			llog("thekraken: recording logfile and stderr activity to " RECORD_FN "\n");
+		}
+	}
+
+	if (conf_energy) {
+		int k = energy_init();
+
+		if (k > 0) {
+			llog("thekraken: energy: sampling %d RAPL counter(s)\n", k);
+		} else if (k == 0) {
+			llog("thekraken: energy: no RAPL counters found\n");
+		} else {
+			llog("thekraken: energy: cannot read RAPL counters: %s\n", strerror(errno));
+		}
+	}
+
+	if (conf_warmup) {
+		int node = cpu_norder > 0 ? topo_cpu_node(cpu_order[0]) : -1;
+
+		/* master thread reads WU data; its node gets the page cache */
+		wpid = warmup_start(nbin, node, &warm);
+		if (wpid < 0) {
+			llog("thekraken: warm-up failed: %s\n", strerror(errno));
+		} else if (wpid == 0) {
+			llog("thekraken: warm-up: %d file(s) (%ld MB) already cached\n", warm.files, warm.bytes >> 20);
+		} else {
+			llog("thekraken: warm-up job created (%d): %d file(s), %ld MB, node %d\n", wpid, warm.files, warm.bytes >> 20, node);
+		}
+	}
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, repfd)) {
+		llog("thekraken: socketpair: %s\n", strerror(errno));
+		return -1;
+	}
 	cpid = fork();
 	if (cpid == -1) {
 		llog("thekraken: fork: %s\n", strerror(errno));
@@ -859,20 +2076,12 @@ int main(int ac, char **av)
 	}
 	if (cpid == 0) {
 		long prv;
-		char **avclone;
-		int i;
-		
-		avclone = malloc((ac + 1) * sizeof(*avclone));
-		for (i = 0; i < ac; i++) {
-			avclone[i] = av[i];
-			if (conf_remap_np && !strcmp(av[i], "-np") && av[i + 1]) {
-				if (!strcmp(av[i + 1], "40")) {
-					avclone[i + 1] = "44";
-					i++;
-				}
-			}
+
+		close(repfd[0]);
+		sigprocmask(SIG_UNBLOCK, &sigchld, NULL);
+		if (conf_observe) {
+			observe_child();
 		}
-		avclone[ac] = NULL;
 
 		prv = ptrace(PTRACE_TRACEME, 0, 0, 0);
 		if (prv == -1) {
@@ -881,17 +2090,306 @@ int main(int ac, char **av)
 		}
 		llog("thekraken: child: ptrace(PTRACE_TRACEME) returns 0\n");
 		llog("thekraken: child: Executing...\n");
-		execvp(nbin, avclone);
-		llog("thekraken: child: exec: %s\n", strerror(errno));
+		/* no llog() from here on; see child_report() */
+		if (conf_iostat && iostat_install()) {
+			child_report(repfd[1], "cannot install seccomp filter: %s; I/O statistics disabled", strerror(errno));
+		}
+		if (conf_setaffinity && affguard_install()) {
+			child_report(repfd[1], "cannot install seccomp filter: %s; sched_setaffinity() not intercepted", strerror(errno));
+		}
+		execvpe(nbin, core_av, core_env);
+		child_report(repfd[1], "exec: %s", strerror(errno));
 		return -1;
 	}
 		
 	llog("thekraken: Forked %d.\n", cpid);
+	close(repfd[1]);
+	/*
+	 * until exec closes the child's end (or it exits); bounded, as a
+	 * signal stopping the child before exec waits for us
+	 */
+	setsockopt(repfd[0], SOL_SOCKET, SO_RCVTIMEO, &(struct timeval){ 2, 0 }, sizeof(struct timeval));
+	while (1) {
+		char buf[STR_BUF_SIZE];
+		ssize_t n = recv(repfd[0], buf, sizeof(buf) - 1, 0);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		buf[n] = '\0';
+		llog("thekraken: child: %s\n", buf);
+	}
+	close(repfd[0]);
+	if (conf_observe) {
+		observe_parent();
+	}
+
+	if (conf_control && ctl_init() != -1) {
+		atexit(ctl_cleanup);
+	}
+
+	sigfd = signalfd(-1, &sigchld, SFD_CLOEXEC | SFD_NONBLOCK);
+	if (sigfd == -1) {
+		llog("thekraken: signalfd: %s\n", strerror(errno));
+		return -1;
+	}
 	
 	while (1) {
 		int rv;
 
-		rv = waitpid(-1, &status, __WALL);
+		if (events & LOGSCAN_FIRST_STEP && first_step == 0) {
+			int dlbload_workers = (nclones - 2) / 2;
+
+			rv = evpid;
+			llog("thekraken: %d: first step identified\n", rv);
+			first_step = 1;
+			first_step_time = time(NULL);
+
+			if (conf_autotune) {
+				project = ledger_project(fah_slot);
+				if (conf_autotune == 2 && project >= 0) {
+					struct ledger_conf c = lconf;
+
+					if (ledger_choose(project, core, np, conf_autotune_explore, &c)) {
+						if (c.placement != lconf.placement) {
+							cpu_norder = repin(c.placement, cpu_order);
+							if (conf_isolate) {
+								isolate(cpu_order, cpu_norder, np ? np + 1 : cpu_norder);
+							}
+							if (conf_power) {
+								power_set(cpu_order, cpu_norder, np ? np + 1 : cpu_norder);
+							}
+						}
+						conf_placement = c.placement;
+						conf_dlbload_onperiod = c.onperiod;
+						conf_dlbload_offperiod = c.offperiod;
+						lconf = c;
+					}
+				}
+			}
+			commaff_start();
+			energy_start(fah_slot);
+			if (conf_watchdog) {
+				if (watchdog_start(cpid, fah_slot, conf_watchdog)) {
+					llog("thekraken: %d: cannot start watchdog: %s\n", rv, strerror(errno));
+				} else {
+					llog("thekraken: %d: watchdog: stall after %d times rolling TPF without progress%s\n", rv, conf_watchdog, conf_watchdog_restart ? "; FahCore restarted then" : "");
+				}
+			}
+
+			{
+				char fn[24];
+
+				snprintf(fn, sizeof(fn), "work/wudata_%s.dyn", fah_slot);
+				utimes(fn, NULL);
+			}
+
+			if (conf_dlbload && dlbload_workers > 0) {
+				if (conf_dlbload_engine == 1 && conf_observe) {
+					llog("thekraken: %d: throttling needs FahCore traced; using synthload in observation mode\n", rv);
+				}
+				synthload_start_time = time(NULL);
+				mpid = dlbload_spawn(rv, dlbload_workers, cpu_order, cpu_norder, !conf_observe);
+				if (mpid < 0) {
+					tpid = -1;
+				}
+			}
+			energy_phase(mpid > 0 || throttle_fd() != -1 ? "dlbload" : "run");
+			if (conf_numamig) {
+				npid = numamig_start(cpid, conf_numamig_interval, conf_numamig_rate, 0);
+				if (npid < 0) {
+					llog("thekraken: %d: numamig_start failed: %s\n", rv, strerror(errno));
+				} else {
+					llog("thekraken: %d: NUMA migration job created (%d): every %ds, up to %d pages/s\n", rv, npid, conf_numamig_interval, conf_numamig_rate);
+				}
+			}
+			if (conf_thp) {
+				hpid = thp_start(cpid, conf_thp_minsize, conf_thp_chunk, conf_thp_interval, 0);
+				if (hpid < 0) {
+					llog("thekraken: %d: thp_start failed: %s\n", rv, strerror(errno));
+				} else {
+					llog("thekraken: %d: THP collapse job created (%d): mappings >= %dMB, %dMB pieces every %dms\n", rv, hpid, conf_thp_minsize, conf_thp_chunk, conf_thp_interval);
+				}
+			}
+			if (conf_startup_deadline != 0) {
+				llog("thekraken: %d: startup complete\n", rv);
+				if (wpid > 0) {
+					warmup_report(rv, &warm);
+				}
+				alarm(0);
+				if (!conf_dlbload) {
+					tpid = -1;
+				}
+			}
+			if (conf_observe && !detached) {
+				/* all threads exist by now */
+				detach_all(rv);
+				detached = 1;
+			}
+		}
+		if (events & LOGSCAN_DLB) {
+			rv = evpid;
+			if (first_step_time && dlb_time < 0) {
+				dlb_time = time(NULL) - first_step_time;
+			}
+			if (mpid > 0) {
+				llog("thekraken: %d: DLB has engaged; killing synthetic load manager\n", rv);
+				kill(mpid, SIGTERM);
+			} else if (throttle_fd() != -1) {
+				llog("thekraken: %d: DLB has engaged; releasing throttled ranks (run time: %ld seconds)\n", rv, time(NULL) - synthload_start_time);
+				throttle_stop();
+			} else {
+				llog("thekraken: %d: DLB has engaged\n", rv);
+			}
+			tpid = -1; /* don't monitor the talkative thread anymore */
+			energy_phase("run");
+		}
+		events = 0;
+
+		if (!wait_pending) {
+			struct signalfd_siginfo si;
+			int nfds = 0, timeout;
+
+			pfd[nfds].fd = sigfd;
+			pfd[nfds++].events = POLLIN;
+			if (conf_observe) {
+				if (!errfd_eof) {
+					pfd[nfds].fd = observe_errfd();
+					pfd[nfds++].events = POLLIN;
+				}
+				pfd[nfds].fd = observe_logfd();
+				pfd[nfds++].events = POLLIN;
+			}
+			if (ctl_fd() != -1) {
+				/* one connection at a time */
+				pfd[nfds].fd = ctl_conn_fd() != -1 ? ctl_conn_fd() : ctl_fd();
+				pfd[nfds++].events = POLLIN;
+			}
+			if (throttle_fd() != -1) {
+				pfd[nfds].fd = throttle_fd();
+				pfd[nfds++].events = POLLIN;
+			}
+			if (energy_fd() != -1) {
+				pfd[nfds].fd = energy_fd();
+				pfd[nfds++].events = POLLIN;
+			}
+			if (watchdog_fd() != -1) {
+				pfd[nfds].fd = watchdog_fd();
+				pfd[nfds++].events = POLLIN;
+			}
+			timeout = conf_observe ? observe_timeout() : -1;
+			if (ctl_timeout() != -1 && (timeout == -1 || ctl_timeout() < timeout)) {
+				timeout = ctl_timeout();
+			}
+			rv = poll(pfd, nfds, timeout);
+			if (rv == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				llog("thekraken: poll: %s\n", strerror(errno));
+				return -1;
+			}
+			while (read(sigfd, &si, sizeof(si)) == sizeof(si)) {
+				wait_pending = 1;
+			}
+			if (throttle_fd() != -1 && throttle_tick()) {
+				llog("thekraken: %d: throttling reached deadline (run time: %ld seconds)\n", cpid, time(NULL) - synthload_start_time);
+				energy_phase("run");
+			}
+			energy_tick();
+			if (watchdog_tick() && conf_watchdog_restart && watchdog_restart()) {
+				llog("thekraken: %d: cannot signal FahCore: %s\n", cpid, strerror(errno));
+			}
+			if (conf_observe) {
+				events |= observe_stderr(&errscan, &errfd_eof);
+				events |= observe_log(&logscan, fah_slot);
+				evpid = cpid;
+			}
+			if (ctl_fd() != -1) {
+				char cmd[CTL_CMD_SIZE];
+				int cfd, n;
+
+				while ((cfd = ctl_read(cmd, sizeof(cmd))) != -1) {
+					if (!strcmp(cmd, "status")) {
+						ctl_reply(cfd, "FahCore %d, %d thread(s), first step %s\nplacement %s across %d cpu(s)\nsynthload %s (on %dms, off %dms)\nv=%d\n", cpid, task_count(), first_step ? "identified" : "not identified yet", place_name(conf_placement), cpu_norder, mpid > 0 ? "running" : throttle_fd() != -1 ? "not running (throttling ranks)" : "not running", conf_dlbload_onperiod, conf_dlbload_offperiod, conf_v);
+					} else if (!strncmp(cmd, "set ", 4)) {
+						n = conf_set(cmd + 4);
+						if (n < 0) {
+							ctl_reply(cfd, "error: invalid setting: '%s'\n", cmd + 4);
+							continue;
+						}
+						switch (n) {
+							case CONF_PLACEMENT:
+								cpu_norder = repin(conf_placement, cpu_order);
+								if (conf_isolate) {
+									isolate(cpu_order, cpu_norder, np ? np + 1 : cpu_norder);
+								}
+								if (conf_power) {
+									power_set(cpu_order, cpu_norder, np ? np + 1 : cpu_norder);
+								}
+								lconf.placement = conf_placement;
+								break;
+							case CONF_V:
+								debug_level = 1 + conf_v;
+								break;
+							case CONF_DLBLOAD_ONPERIOD:
+							case CONF_DLBLOAD_OFFPERIOD:
+								lconf.onperiod = conf_dlbload_onperiod;
+								lconf.offperiod = conf_dlbload_offperiod;
+								if (mpid > 0) {
+									/* restart with new periods */
+									kill(mpid, SIGTERM);
+									synthload_start_time = time(NULL);
+									mpid = synthload_spawn(cpid, (nclones - 2) / 2, cpu_order, cpu_norder);
+								} else if (throttle_fd() != -1) {
+									synthload_start_time = time(NULL);
+									throttle_spawn(cpid, (nclones - 2) / 2);
+								}
+								break;
+							default:
+								ctl_reply(cfd, "ok: %s set; not applied to running FahCore\n", conf_key[n]);
+								continue;
+						}
+						ctl_reply(cfd, "ok: %s applied\n", conf_key[n]);
+					} else if (!strcmp(cmd, "synthload start")) {
+						if (mpid > 0) {
+							ctl_reply(cfd, "error: synthload already running (%d)\n", mpid);
+						} else if ((nclones - 2) / 2 <= 0) {
+							ctl_reply(cfd, "error: no ranks to create synthload workers for\n");
+						} else {
+							synthload_start_time = time(NULL);
+							mpid = synthload_spawn(cpid, (nclones - 2) / 2, cpu_order, cpu_norder);
+							ctl_reply(cfd, mpid > 0 ? "ok: synthload started\n" : "error: synthload_start failed\n");
+						}
+					} else if (!strcmp(cmd, "synthload stop")) {
+						if (mpid > 0) {
+							llog("thekraken: %d: stopping synthetic load manager on request\n", mpid);
+							kill(mpid, SIGTERM);
+							mpid = 0;
+							ctl_reply(cfd, "ok: synthload stopped\n");
+						} else if (throttle_fd() != -1) {
+							llog("thekraken: %d: releasing throttled ranks on request\n", cpid);
+							throttle_stop();
+							ctl_reply(cfd, "ok: throttling stopped\n");
+						} else {
+							ctl_reply(cfd, "error: synthload not running\n");
+						}
+					} else {
+						ctl_reply(cfd, "commands: status, set <var>=<value>, synthload start|stop\n");
+					}
+				}
+			}
+			if (!wait_pending) {
+				continue;
+			}
+		}
+
+		rv = waitpid(-1, &status, __WALL | WNOHANG);
+		if (rv == 0) {
+			wait_pending = 0;
+			continue;
+		}
 		if (rv == -1) {
 			llog("thekraken: waitpid() returns -1 (errno %d)\n", errno);
 			if (errno == EINTR) {
@@ -899,7 +2397,9 @@ int main(int ac, char **av)
 			}
 			return -1;
 		}
-		if (rv != tpid && (rv != cpid || fahcore_logfd != -1)) /* ignore the talkative FahCore process or it will flood the log */
+		/* ignore the talkative FahCore process and syscall-traced threads or they will flood the log */
+		quiet = rv == tpid || (rv == cpid && find_logfd) || commaff_tracing(rv) || iostat_pending(rv) || (status >> 16) == PTRACE_EVENT_SECCOMP || throttle_pending(rv);
+		if (!quiet)
 			llog("thekraken: waitpid() returns %d with status 0x%08x\n", rv, status);
 
 		if (WIFEXITED(status)) {
@@ -908,13 +2408,36 @@ int main(int ac, char **av)
 				time_t runtime = time(NULL) - synthload_start_time;
 
 				llog("thekraken: %d: synthetic load manager exited (run time: %ld seconds)\n", rv, runtime);
+				energy_phase("run");
 				tpid = -1;
+				mpid = 0;
+				continue;
+			}
+			if (rv == npid) {
+				llog("thekraken: %d: NUMA migration job exited\n", rv);
+				continue;
+			}
+			if (rv == hpid) {
+				llog("thekraken: %d: THP collapse job exited\n", rv);
+				continue;
+			}
+			if (rv == wpid) {
+				warmup_done(&warm);
+				warmup_report(rv, &warm);
 				continue;
 			}
 			if (rv != cpid) {
-				llog("thekraken: %d: ignoring clone exit\n", rv);
+				clone_gone(rv);
 				continue;
 			}
+			if (conf_iostat) {
+				iostat_report();
+			}
+			energy_report();
+			watchdog_finish(core);
+			if (conf_autotune) {
+				ledger_record(project >= 0 ? project : ledger_project(fah_slot), core, np, &lconf, dlb_time, fah_slot);
+			}
 			return WEXITSTATUS(status);
 		}
 		if (WIFSIGNALED(status)) {
@@ -926,12 +2449,37 @@ int main(int ac, char **av)
 				
 				llog("thekraken: %d: synthetic load manager terminated (run time: %ld seconds)\n", rv, runtime);
 				tpid = -1;
+				mpid = 0;
+				continue;
+			}
+			if (rv == npid) {
+				llog("thekraken: %d: NUMA migration job terminated\n", rv);
+				continue;
+			}
+			if (rv == hpid) {
+				llog("thekraken: %d: THP collapse job terminated\n", rv);
+				continue;
+			}
+			if (rv == wpid) {
+				warmup_done(&warm);
+				llog("thekraken: %d: warm-up job terminated\n", rv);
 				continue;
 			}
 			if (rv != cpid) {
-				llog("thekraken: %d: ignoring clone termination\n", rv);
+				clone_gone(rv);
 				continue;
 			}
+			if (conf_iostat) {
+				iostat_report();
+			}
+			energy_report();
+			watchdog_finish(core);
+			if (conf_autotune) {
+				ledger_record(project >= 0 ? project : ledger_project(fah_slot), core, np, &lconf, dlb_time, fah_slot);
+			}
+			ctl_cleanup();
+			isolate_restore();
+			power_unset();
 			signal(WTERMSIG(status), SIG_DFL);
 			raise(WTERMSIG(status));
 			return -1;
@@ -941,7 +2489,7 @@ int main(int ac, char **av)
 			long prv;
 			int ptrace_request;
 
-			if (rv != tpid && (rv != cpid || fahcore_logfd != -1)) /* ignore the talkative FahCore process or it will flood the log */
+			if (!quiet)
 				llog("thekraken: %d: stopped with signal 0x%08x\n", rv, WSTOPSIG(status));
 
 			if (WSTOPSIG(status) == SIGTRAP) {
@@ -951,45 +2499,78 @@ int main(int ac, char **av)
 				if (nclones == -1 && e == 0) {
 					/* initial attach */
 					llog("thekraken: %d: initial attach\n", rv);
-					prv = ptrace(PTRACE_SETOPTIONS, rv, 0, PTRACE_O_TRACECLONE);
+					policy_apply(ROLE_MAIN, rv);
+					task_add(rv, ROLE_MAIN, 0, -1, -1);
+					if (conf_iostat) {
+						/* seccomp filter is in place; don't leave FahCore with failing syscalls if we die */
+						prv = ptrace(PTRACE_SETOPTIONS, rv, 0, PTRACE_O_TRACECLONE | PTRACE_O_TRACESECCOMP | PTRACE_O_EXITKILL);
+					} else if (conf_setaffinity) {
+						/* a failing sched_setaffinity() won't hurt FahCore if we die */
+						prv = ptrace(PTRACE_SETOPTIONS, rv, 0, PTRACE_O_TRACECLONE | PTRACE_O_TRACESECCOMP);
+					} else {
+						prv = ptrace(PTRACE_SETOPTIONS, rv, 0, PTRACE_O_TRACECLONE);
+					}
 					llog("thekraken: %d: Continuing.\n", rv);
-					prv = ptrace(PTRACE_SYSCALL, rv, 0, 0);
+					prv = ptrace(find_logfd ? PTRACE_SYSCALL : PTRACE_CONT, rv, 0, 0);
 					nclones++;
 					continue;
 				}
 
-				if (e & PTRACE_EVENT_CLONE) {
+				if (e == PTRACE_EVENT_SECCOMP) {
+					/* file related syscall entry; let us know when it's done */
+					struct user_regs_struct regs;
+
+					ptrace(PTRACE_GETREGS, rv, NULL, &regs);
+					if (regs.orig_rax == SYS_sched_setaffinity) {
+						affguard_syscall(rv, &regs, conf_setaffinity);
+						ptrace_request = rv == tpid || (rv == cpid && find_logfd) || commaff_tracing(rv) ? PTRACE_SYSCALL : PTRACE_CONT;
+						prv = ptrace(ptrace_request, rv, 0, 0);
+						continue;
+					}
+					iostat_entry(rv, &regs);
+					prv = ptrace(PTRACE_SYSCALL, rv, 0, 0);
+					continue;
+				}
+
+				if (e == PTRACE_EVENT_CLONE) {
 					int c;
+					int role;
 
 					prv = ptrace(PTRACE_GETEVENTMSG, rv, 0, &cloned);
 					c = cloned;
 					llog("thekraken: %d: cloned %d\n", rv, c);
 					nclones++;
-					if (nclones != 2 && nclones != 3) {
-						llog("thekraken: %d: binding %d to cpu %d\n", rv, c, last_used_cpu);
-						CPU_ZERO(&cpuset);
-						CPU_SET(last_used_cpu, &cpuset);
-						last_used_cpu++;
-						sched_setaffinity(c, sizeof(cpuset), &cpuset);
+					record_event(REC_CLONE, nclones, NULL, 0);
+					role = place_thread(rv, c, nclones, cpu_order, cpu_norder);
+					if (role != ROLE_HELPER) {
+						commaff_add(c);
 					}
 					if (nclones == 1) {
-						if (conf_dlbload == 1) {
+						if (conf_dlbload == 1 && !conf_observe) {
 							llog("thekraken: %d: talkative FahCore process identified (%d), listening to syscalls\n", rv, c);
 							tpid = c;
 						}
 						if (conf_startup_deadline != 0) {
 							llog("thekraken: %d: startup deadline in %d seconds\n", rv, conf_startup_deadline);
 							alarm(conf_startup_deadline);
-							tpid = c;
+							if (!conf_observe)
+								tpid = c;
 						}
 					}
 
+					if (conf_observe && !detached && nclones == expected_clones) {
+						/* all threads bound; nothing more to trace */
+						detach_all(rv);
+						detached = 1;
+						continue;
+					}
+
 					/*
 					 * The following's quite dirty; we're relying on the fact that
 					 * tpid clones add'l threads; if that wasn't the case, calling
 					 * ptrace(PTRACE_SYSCALL, tpid, ...) would be challenging...
 					 */
-					if (rv == tpid || (rv == cpid && fahcore_logfd == -1)) {
+					if (rv == tpid || (rv == cpid && find_logfd) || commaff_tracing(rv)) {
 						llog("thekraken: %d: Continuing (SYSCALL).\n", rv);
 						prv = ptrace(PTRACE_SYSCALL, rv, 0, 0);	
 					} else {
@@ -999,78 +2580,41 @@ int main(int ac, char **av)
 					continue;
 				}
 
+				if (e == 0 && iostat_pending(rv)) {
+					struct user_regs_struct regs;
+
+					ptrace(PTRACE_GETREGS, rv, NULL, &regs);
+					iostat_exit(rv, &regs);
+					if (rv != tpid && (rv != cpid || !find_logfd) && !commaff_tracing(rv)) {
+						prv = ptrace(PTRACE_CONT, rv, 0, 0);
+						continue;
+					}
+				}
+
 				if (rv == tpid) {
 					/* this is the talkative fah process. Check for data written to stderr or the logfile (fd 5) */
 					long call, fd, msgaddr, msglen;
 					struct user_regs_struct regs;
 
 					ptrace(PTRACE_GETREGS, rv, NULL, &regs);
+					if (commaff_tracing(rv)) {
+						commaff_syscall(rv, &regs);
+					}
 					call = regs.orig_rax;
 					fd = regs.rdi;
 					msgaddr = regs.rsi;
 					msglen = regs.rdx;
 
-					if (call == SYS_write && fd == fahcore_logfd) {
-						if (!tpid_insyscall) {
-							tpid_insyscall = 1;
-							getstr(rv, msgaddr, msglen, fahcore_logbuf, &fahcore_logbufpos, sizeof(fahcore_logbuf));
-							if (strchr(fahcore_logbuf, '\n') != NULL) {
-								if (first_step == 0 && strstr(fahcore_logbuf, "Completed ") != NULL && strstr(fahcore_logbuf, "out of") != NULL) {
-									int dlbload_workers = (nclones - 2) / 2;
-
-									llog("thekraken: %d: first step identified\n", rv);
-									first_step = 1;
-
-									{
-										char fn[24];
-
-										snprintf(fn, sizeof(fn), "work/wudata_%s.dyn", fah_slot);
-										utimes(fn, NULL);
-									}
-
-									if (conf_dlbload && dlbload_workers > 0) {
-										llog("thekraken: %d: creating %d synthload workers: on %dms, off %dms, deadline %dms\n", rv, dlbload_workers, conf_dlbload_onperiod, conf_dlbload_offperiod, conf_dlbload_deadline);
-										synthload_start_time = time(NULL);
-										mpid = synthload_start(conf_dlbload_onperiod, conf_dlbload_offperiod, conf_dlbload_deadline, dlbload_workers, conf_startcpu);
-										if (mpid < 0) {
-											llog("thekraken: %d: synthload_start failed: %s (rv: %d)\n", rv, strerror(errno), mpid);
-											tpid = -1;
-										}
-										llog("thekraken: %d: synthload manager created (%d)\n", rv, mpid);
-									}
-									if (conf_startup_deadline != 0) {
-										llog("thekraken: %d: startup complete\n", rv);
-										alarm(0);
-										if (!conf_dlbload) {
-											tpid = -1;
-										}
-									}
-								}
-								fahcore_logbufpos = 0;
-							}
-							if (fahcore_logbufpos == sizeof(fahcore_logbuf) - 1) {
-								llog("thekraken: %d: log buffer overflow! Clearing the buffer.\n", rv);
-								fahcore_logbufpos = 0;
-							}
-						} else {
-							tpid_insyscall = 0;
-						}
-					} else if (call == SYS_write && fd == STDERR_FILENO) {
+					if (call == SYS_write && (fd == fahcore_logfd || fd == STDERR_FILENO)) {
 						if (!tpid_insyscall) {
+							char data[LOGSCAN_BUF_SIZE];
+							int datalen = 0;
+
 							tpid_insyscall = 1;
-							getstr(rv, msgaddr, msglen, fahcore_errbuf, &fahcore_errbufpos, sizeof(fahcore_errbuf));
-							if (strchr(fahcore_errbuf, '\n') != NULL) {
-								if (strstr(fahcore_errbuf, "Turning on dynamic load balancing") != NULL) {
-									llog("thekraken: %d: DLB has engaged; killing synthetic load manager\n", rv);
-									kill(mpid, SIGTERM);
-									tpid = -1; /* don't monitor the talkative thread anymore */
-								}
-								fahcore_errbufpos = 0;
-							}
-							if (fahcore_errbufpos == sizeof(fahcore_errbuf) - 1) {
-								llog("thekraken: %d: stderr buffer overflow! Clearing the buffer.\n", rv);
-								fahcore_errbufpos = 0;
-							}
+							getstr(rv, msgaddr, msglen, data, &datalen, sizeof(data));
+							record_event(REC_WRITE, fd, data, datalen);
+							events |= logscan_feed(fd == STDERR_FILENO ? &errscan : &logscan, data, datalen);
+							evpid = rv;
 						} else {
 							tpid_insyscall = 0;
 						}
@@ -1081,7 +2625,7 @@ int main(int ac, char **av)
 					continue;
 				}
 
-				if (rv == cpid && fahcore_logfd == -1) {
+				if (rv == cpid && find_logfd) {
 					long call, fn, ret;
 					struct user_regs_struct regs;
 
@@ -1096,19 +2640,15 @@ int main(int ac, char **av)
 						} else {
 							char buf[16];
 							int bufpos = 0;
-							char *tmp;
 
 							cpid_insyscall = 0;
 
 							getstr(rv, fn, -1, buf, &bufpos, sizeof(buf));
-							if ((tmp = strstr(buf, "/logfile_"))) {
+							record_event(REC_OPEN, ret, buf, strlen(buf));
+							if (logscan_logfile(buf, fah_slot)) {
 								llog("thekraken: %d: logfile fd: %ld (pathname: %s)\n", rv, ret, buf);
 								fahcore_logfd = ret;
-								if (tmp[9] != '\0' && tmp[10] != '\0') {
-									fah_slot[0] = tmp[9];
-									fah_slot[1] = tmp[10];
-									fah_slot[2] = '\0';
-								}
+								find_logfd = 0;
 							}
 						}
 					}
@@ -1117,12 +2657,26 @@ int main(int ac, char **av)
 					continue;
 				}
 
+				if (commaff_tracing(rv)) {
+					/* compute thread being watched for futex wake-ups */
+					struct user_regs_struct regs;
+
+					ptrace(PTRACE_GETREGS, rv, NULL, &regs);
+					if (commaff_syscall(rv, &regs)) {
+						prv = ptrace(PTRACE_SYSCALL, rv, 0, 0);
+					} else {
+						llog("thekraken: %d: Continuing.\n", rv);
+						prv = ptrace(PTRACE_CONT, rv, 0, 0);
+					}
+					continue;
+				}
+
 				llog("thekraken: %d: Continuing (unhandled trap).\n", rv);
 				prv = ptrace(PTRACE_CONT, rv, 0, 0);
 				continue;
 			}
 
-			if (rv == tpid || (rv == cpid && fahcore_logfd == -1)) {
+			if (rv == tpid || (rv == cpid && find_logfd) || commaff_tracing(rv)) {
 				ptrace_request = PTRACE_SYSCALL;
 			} else {
 				ptrace_request = PTRACE_CONT;
@@ -1130,7 +2684,7 @@ int main(int ac, char **av)
 
 			if (rv == tpid) {
 				tpid_insyscall = 0;
-			} else if (rv == cpid && fahcore_logfd == -1) {
+			} else if (rv == cpid && find_logfd) {
 				cpid_insyscall = 0;
 			}
 
@@ -1151,6 +2705,10 @@ int main(int ac, char **av)
 			}
 
 			if (WSTOPSIG(status) == SIGSTOP) {
+				if (throttle_held(rv, ptrace_request)) {
+					/* ours; held until the next pulse ends */
+					continue;
+				}
 				llog("thekraken: %d: Continuing%s.\n", rv, ptrace_request == PTRACE_SYSCALL ? " (SYSCALL)" : "");
 				prv = ptrace(ptrace_request, rv, 0, 0);
 				continue;
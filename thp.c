@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <linux/mempolicy.h>
+
+#include "topology.h"
+#include "thp.h"
+#include "llog.h"
+
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_process_madvise
+#define SYS_process_madvise 440
+#endif
+
+#define HPAGE_SIZE (2UL << 20)
+#define THP_ENABLED "/sys/kernel/mm/transparent_hugepage/enabled"
+
+static long anon_huge_kb(pid_t pid)
+{
+	FILE *fp;
+	char fn[PATH_MAX];
+	char buf[256];
+	long kb = -1;
+
+	topo_path(fn, sizeof(fn), "/proc/%d/smaps_rollup", pid);
+	fp = fopen(fn, "r");
+	if (!fp) {
+		return -1;
+	}
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (sscanf(buf, "AnonHugePages: %ld kB", &kb) == 1)
+			break;
+	}
+	fclose(fp);
+	return kb;
+}
+
+/* make our own allocations (and the collapse, done on our behalf) prefer 'node' */
+static void move_to_node(int node)
+{
+	unsigned long mask[TOPO_MAX_NODES / (8 * sizeof(unsigned long))] = { 0, };
+
+	if (topo_nr_nodes() < 2 || node < 0 || node >= TOPO_MAX_NODES) {
+		return;
+	}
+	topo_bind_node(0, node);
+	mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+	/* the kernel reads maxnode - 1 bits */
+	syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, TOPO_MAX_NODES + 1);
+}
+
+/*
+ * Collapses [start, end) in 'chunk'-sized pieces; returns number of pieces
+ * collapsed or -1 if further attempts are pointless (e.g. lacking privileges).
+ */
+static int collapse_range(int pidfd, pid_t pid, unsigned long start, unsigned long end, unsigned long chunk, unsigned int interval)
+{
+	unsigned long addr;
+	int ok = 0;
+
+	for (addr = start; addr < end; addr += chunk) {
+		struct iovec iov;
+		int node;
+
+		iov.iov_base = (void *)addr;
+		iov.iov_len = end - addr < chunk ? end - addr : chunk;
+
+		node = topo_page_node(pid, addr);
+		if (node >= 0) {
+			move_to_node(node);
+		}
+		if (syscall(SYS_process_madvise, pidfd, &iov, 1, MADV_COLLAPSE, 0) < 0) {
+			if (errno == EPERM || errno == ENOSYS || errno == ESRCH) {
+				llog("thekraken: thp: process_madvise(MADV_COLLAPSE): %s\n", strerror(errno));
+				return -1;
+			}
+			if (errno == EINVAL) {
+				/* mapping not eligible (or MADV_COLLAPSE not supported); skip it */
+				debug(1) llog("thekraken: thp: %lx-%lx: %s, skipping mapping\n", addr, end, strerror(errno));
+				return ok;
+			}
+			debug(2) llog("thekraken: thp: %lx-%lx (node %d): %s\n", addr, addr + iov.iov_len, node, strerror(errno));
+		} else {
+			debug(2) llog("thekraken: thp: %lx-%lx (node %d): collapsed\n", addr, addr + iov.iov_len, node);
+			ok++;
+		}
+		usleep(interval * 1000);
+	}
+	return ok;
+}
+
+/*
+ * Forks a job which collapses FahCore's large anonymous mappings into
+ * transparent huge pages using process_madvise(MADV_COLLAPSE). Useful with
+ * THP set to 'madvise' where FahCore's heap would otherwise stay on 4K pages.
+ *
+ * pid      - FahCore PID
+ * minsize  - smallest mapping (in MB) considered for collapsing
+ * chunk    - size of a piece (in MB) collapsed at once
+ * interval - number of ms to sleep between pieces
+ * outlive  - keep running after we exit
+ */
+pid_t thp_start(pid_t pid, unsigned int minsize, unsigned int chunk, unsigned int interval, int outlive)
+{
+	pid_t hpid;
+	FILE *fp;
+	char buf[512];
+	long before, after;
+	int pidfd;
+	int pieces = 0;
+
+	hpid = fork();
+	if (hpid != 0) {
+		return hpid;
+	}
+
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGHUP, SIG_DFL);
+	signal(SIGTSTP, SIG_DFL);
+	signal(SIGALRM, SIG_DFL);
+	if (outlive) {
+		setsid();
+	} else {
+		prctl(PR_SET_PDEATHSIG, SIGHUP);
+	}
+
+	fp = fopen(topo_path(buf, sizeof(buf), THP_ENABLED), "r");
+	if (fp) {
+		if (fgets(buf, sizeof(buf), fp) && strstr(buf, "[never]")) {
+			llog("thekraken: thp: transparent huge pages disabled system-wide, nothing to do\n");
+			_exit(0);
+		}
+		fclose(fp);
+	}
+
+	pidfd = syscall(SYS_pidfd_open, pid, 0);
+	if (pidfd == -1) {
+		llog("thekraken: thp: pidfd_open: %s\n", strerror(errno));
+		_exit(1);
+	}
+
+	before = anon_huge_kb(pid);
+
+	topo_path(buf, sizeof(buf), "/proc/%d/maps", pid);
+	fp = fopen(buf, "r");
+	if (!fp) {
+		_exit(1);
+	}
+	while (fgets(buf, sizeof(buf), fp)) {
+		unsigned long start, end;
+		char perms[8];
+		char path[256];
+		int rv;
+
+		path[0] = '\0';
+		if (sscanf(buf, "%lx-%lx %7s %*s %*s %*s %255s", &start, &end, perms, path) < 3)
+			continue;
+		if (perms[0] != 'r' || perms[1] != 'w' || perms[3] != 'p')
+			continue;
+		if (path[0] != '\0' && strcmp(path, "[heap]"))
+			continue;
+		start = (start + HPAGE_SIZE - 1) & ~(HPAGE_SIZE - 1);
+		end &= ~(HPAGE_SIZE - 1);
+		if (end <= start || end - start < (unsigned long)minsize << 20)
+			continue;
+		debug(1) llog("thekraken: thp: collapsing %lx-%lx (%lu MB)\n", start, end, (end - start) >> 20);
+		rv = collapse_range(pidfd, pid, start, end, (unsigned long)chunk << 20, interval);
+		if (rv < 0)
+			break;
+		pieces += rv;
+	}
+	fclose(fp);
+	close(pidfd);
+
+	after = anon_huge_kb(pid);
+	if (before >= 0 && after >= 0) {
+		llog("thekraken: thp: collapsed %d pieces; AnonHugePages: %ld kB -> %ld kB (delta %+ld kB)\n", pieces, before, after, after - before);
+	} else {
+		llog("thekraken: thp: collapsed %d pieces\n", pieces);
+	}
+	_exit(0);
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Zero-burn DLB trigger (dlbload_engine=1): instead of synthload workers
+ * competing with every other rank for its cpu, those ranks themselves
+ * are paused for THROTTLE_PULSE ms out of every 2 * THROTTLE_PULSE during
+ * the on period, which costs them about the same share of cpu time
+ * without burning any power.
+ *
+ * Pauses go through the tracer: a SIGSTOP sent to a traced thread turns
+ * into a signal-delivery-stop only we get to see, and the thread stays
+ * stopped until we restart it (suppressing the signal), so there's no
+ * group stop and nothing else notices. Everything is driven by a timerfd
+ * polled in the main loop.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+#include "throttle.h"
+
+#define THROTTLE_PULSE 10 /* ms */
+
+#define T_RUNNING 0
+#define T_SIGNALLED 1	/* SIGSTOP sent, stop not reported yet */
+#define T_HELD 2	/* stopped; restart with 'request' */
+
+struct target {
+	pid_t tid;
+	int state;
+	int request;
+};
+
+static struct target *targets;
+static int ntargets;
+static pid_t _tgid;
+static int tfd = -1;
+static unsigned int _onperiod, _offperiod, _deadline;
+static struct timespec t0;
+
+static void release(struct target *t)
+{
+	ptrace(t->request, t->tid, 0, 0);
+	t->state = T_RUNNING;
+}
+
+/*
+ * Starts pulsing threads 'tids' (of FahCore 'tgid', traced by us) for
+ * 'onperiod' ms every 'onperiod' + 'offperiod' ms until throttle_stop()
+ * or 'deadline' ms (0: no deadline). Returns timerfd to poll for throttle_tick(), -1 on
+ * error.
+ */
+int throttle_start(unsigned int onperiod, unsigned int offperiod, unsigned int deadline, pid_t tgid, const pid_t *tids, int n)
+{
+	struct itimerspec its = { { 0, THROTTLE_PULSE * 1000000 }, { 0, THROTTLE_PULSE * 1000000 } };
+	int i;
+
+	throttle_stop();
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (tfd == -1) {
+		return -1;
+	}
+	if (timerfd_settime(tfd, 0, &its, NULL)) {
+		close(tfd);
+		tfd = -1;
+		return -1;
+	}
+	/* threads from a previous run still on their way to a stop are kept */
+	targets = realloc(targets, (ntargets + n) * sizeof(*targets));
+	for (i = 0; i < n; i++) {
+		targets[ntargets].tid = tids[i];
+		targets[ntargets].state = T_RUNNING;
+		targets[ntargets++].request = PTRACE_CONT;
+	}
+	_tgid = tgid;
+	_onperiod = onperiod;
+	_offperiod = offperiod;
+	_deadline = deadline;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	return tfd;
+}
+
+int throttle_fd(void)
+{
+	return tfd;
+}
+
+/*
+ * To be called when throttle_fd() is readable: pauses or releases
+ * targets as the duty cycle calls for. Returns 1 once the deadline has
+ * been reached (throttling stopped), 0 otherwise.
+ */
+int throttle_tick(void)
+{
+	struct timespec t;
+	unsigned long long expirations;
+	unsigned int ms, phase;
+	int pause, i;
+
+	if (tfd == -1) {
+		return 0;
+	}
+	while (read(tfd, &expirations, sizeof(expirations)) > 0)
+		;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	ms = (t.tv_sec - t0.tv_sec) * 1000 + (t.tv_nsec - t0.tv_nsec) / 1000000;
+	if (_deadline && ms >= _deadline) {
+		throttle_stop();
+		return 1;
+	}
+	phase = ms % (_onperiod + _offperiod);
+	pause = phase < _onperiod && (phase / THROTTLE_PULSE) % 2 == 0;
+	for (i = 0; i < ntargets; i++) {
+		struct target *tg = &targets[i];
+
+		if (pause && tg->state == T_RUNNING) {
+			if (syscall(SYS_tgkill, _tgid, tg->tid, SIGSTOP) == 0) {
+				tg->state = T_SIGNALLED;
+			}
+		} else if (!pause && tg->state == T_HELD) {
+			release(tg);
+		}
+	}
+	return 0;
+}
+
+static struct target *signalled(pid_t tid)
+{
+	int i;
+
+	for (i = 0; i < ntargets; i++) {
+		if (targets[i].tid == tid && targets[i].state == T_SIGNALLED)
+			return &targets[i];
+	}
+	return NULL;
+}
+
+/* whether thread 'tid' has a SIGSTOP of ours on its way */
+int throttle_pending(pid_t tid)
+{
+	return signalled(tid) != NULL;
+}
+
+/*
+ * To be called when traced thread 'tid' reports SIGSTOP; 'request' is how
+ * it's to be restarted. Returns 1 if the stop was ours (the thread is
+ * either held or restarted with the signal suppressed), 0 if it's someone
+ * else's business.
+ */
+int throttle_held(pid_t tid, int request)
+{
+	struct target *tg = signalled(tid);
+
+	if (!tg) {
+		return 0;
+	}
+	tg->request = request;
+	if (tfd != -1) {
+		tg->state = T_HELD;
+	} else {
+		release(tg);
+	}
+	return 1;
+}
+
+/* restarts held threads; those still to report their stop are restarted when they do */
+void throttle_stop(void)
+{
+	int i, n = 0;
+
+	if (tfd != -1) {
+		close(tfd);
+		tfd = -1;
+	}
+	for (i = 0; i < ntargets; i++) {
+		if (targets[i].state == T_HELD)
+			release(&targets[i]);
+		if (targets[i].state == T_SIGNALLED)
+			targets[n++] = targets[i];
+	}
+	ntargets = n;
+}
@@ -0,0 +1,612 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <limits.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "topology.h"
+
+#define NODE_DIR "/sys/devices/system/node"
+#define CPU_DIR "/sys/devices/system/cpu"
+#define CPU_POSSIBLE CPU_DIR "/possible"
+#define CPU_ONLINE CPU_DIR "/online"
+#define CPU_ISOLATED CPU_DIR "/isolated" /* isolcpus= */
+#define CPU_NOHZ_FULL CPU_DIR "/nohz_full"
+#define CPU_ATOM "/sys/devices/cpu_atom/cpus" /* efficiency cores of hybrid Intel parts */
+#define CLASS_RATIO 70 /* cpus below this % of top capacity count as efficiency cores */
+
+static char root[PATH_MAX]; /* prefix of sysfs and proc lookups; empty: live system */
+static int nr_cpus; /* highest possible cpu + 1 */
+static int nr_nodes = 1;
+static int nr_usable;
+static short *cpu_node; /* -1: cpu offline */
+static int *cpu_llc; /* lowest cpu sharing last level cache; read on demand */
+static int *cpu_core; /* lowest SMT sibling; read on demand */
+static short *cpu_cap; /* relative capacity and class; read on demand */
+static char *cpu_class;
+static int nr_classes = 1;
+static cpu_set_t *usable; /* online and within inherited affinity mask */
+static cpu_set_t *isolated; /* online and isolcpus or nohz_full */
+static size_t setsize;
+
+/*
+ * Makes all sysfs and proc lookups relative to 'dir' (a captured snapshot
+ * of another machine); NULL or empty string means the live system.
+ * topo_init() needs to be called afterwards.
+ */
+void topo_set_root(const char *dir)
+{
+	snprintf(root, sizeof(root), "%s", dir ? dir : "");
+}
+
+const char *topo_root(void)
+{
+	return root;
+}
+
+/* formats path of a sysfs or proc file, prefixed with root set by topo_set_root() */
+char *topo_path(char *buf, size_t size, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	n = snprintf(buf, size, "%s", root);
+	if (n >= size) {
+		n = size - 1;
+	}
+	va_start(ap, fmt);
+	vsnprintf(buf + n, size - n, fmt, ap);
+	va_end(ap);
+	return buf;
+}
+
+/*
+ * Parses kernel-style cpu list (e.g. "0-5,12-17") into 'set' of 'size'
+ * bytes; cpus beyond the set are ignored. Returns number of cpus in the
+ * list or -1 on malformed input.
+ */
+int topo_parse_cpulist(const char *s, cpu_set_t *set, size_t size)
+{
+	int n = 0;
+
+	CPU_ZERO_S(size, set);
+	while (*s && *s != '\n') {
+		char *end;
+		long a, b;
+
+		a = strtol(s, &end, 10);
+		if (end == s || a < 0) {
+			return -1;
+		}
+		b = a;
+		s = end;
+		if (*s == '-') {
+			s++;
+			b = strtol(s, &end, 10);
+			if (end == s || b < a) {
+				return -1;
+			}
+			s = end;
+		}
+		for (; a <= b; a++) {
+			CPU_SET_S(a, size, set);
+			n++;
+		}
+		if (*s == ',') {
+			s++;
+		}
+	}
+	return n;
+}
+
+/* formats 'set' of 'size' bytes as kernel-style cpu list into 'buf' */
+char *topo_format_cpulist(const cpu_set_t *set, size_t size, char *buf, size_t bufsize)
+{
+	int i, first, n = 0;
+	int max = size * 8;
+
+	buf[0] = '\0';
+	for (i = 0; i < max; i++) {
+		if (!CPU_ISSET_S(i, size, set))
+			continue;
+		first = i;
+		while (i + 1 < max && CPU_ISSET_S(i + 1, size, set))
+			i++;
+		if (first == i) {
+			n += snprintf(buf + n, n < bufsize ? bufsize - n : 0, "%s%d", n ? "," : "", first);
+		} else {
+			n += snprintf(buf + n, n < bufsize ? bufsize - n : 0, "%s%d-%d", n ? "," : "", first, i);
+		}
+		if (n >= bufsize)
+			break;
+	}
+	return buf;
+}
+
+/* returns highest cpu in a kernel-style cpu list (lists are sorted) */
+static int cpulist_last(const char *s)
+{
+	const char *p = s + strlen(s);
+
+	while (p > s && !isdigit(p[-1]))
+		p--;
+	while (p > s && isdigit(p[-1]))
+		p--;
+	return isdigit(*p) ? atoi(p) : -1;
+}
+
+static int read_line(const char *fn, char *buf, int size)
+{
+	FILE *fp;
+	int rv = -1;
+
+	fp = fopen(fn, "r");
+	if (!fp) {
+		return -1;
+	}
+	if (fgets(buf, size, fp)) {
+		rv = 0;
+	}
+	fclose(fp);
+	return rv;
+}
+
+int topo_init(void)
+{
+	DIR *d;
+	struct dirent *de;
+	cpu_set_t *set, *inherited;
+	char fn[PATH_MAX];
+	char buf[4096];
+	int i, k;
+
+	nr_cpus = 0;
+	if (!read_line(topo_path(fn, sizeof(fn), CPU_POSSIBLE), buf, sizeof(buf))) {
+		nr_cpus = cpulist_last(buf) + 1;
+	}
+	if (nr_cpus <= 0) {
+		nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	}
+	if (nr_cpus <= 0) {
+		nr_cpus = 1;
+	}
+	nr_nodes = 1;
+
+	free(cpu_node);
+	cpu_node = malloc(nr_cpus * sizeof(*cpu_node));
+	free(cpu_llc);
+	cpu_llc = NULL;
+	free(cpu_core);
+	cpu_core = NULL;
+	free(cpu_cap);
+	cpu_cap = NULL;
+	free(cpu_class);
+	cpu_class = NULL;
+	nr_classes = 1;
+	if (usable) {
+		CPU_FREE(usable);
+	}
+	usable = CPU_ALLOC(nr_cpus);
+	if (isolated) {
+		CPU_FREE(isolated);
+	}
+	isolated = CPU_ALLOC(nr_cpus);
+	set = CPU_ALLOC(nr_cpus);
+	inherited = CPU_ALLOC(nr_cpus);
+	setsize = CPU_ALLOC_SIZE(nr_cpus);
+
+	for (i = 0; i < nr_cpus; i++) {
+		cpu_node[i] = -1;
+	}
+	if (!read_line(topo_path(fn, sizeof(fn), CPU_ONLINE), buf, sizeof(buf)) && topo_parse_cpulist(buf, set, setsize) > 0) {
+		for (i = 0; i < nr_cpus; i++) {
+			if (CPU_ISSET_S(i, setsize, set))
+				cpu_node[i] = 0;
+		}
+	} else {
+		for (i = 0; i < nr_cpus; i++) {
+			cpu_node[i] = 0;
+		}
+	}
+
+	d = opendir(topo_path(fn, sizeof(fn), NODE_DIR));
+	if (d) {
+		while ((de = readdir(d))) {
+			int node;
+
+			if (strncmp(de->d_name, "node", 4) || !isdigit(de->d_name[4]))
+				continue;
+			node = atoi(de->d_name + 4);
+			if (node >= TOPO_MAX_NODES)
+				continue;
+			topo_path(fn, sizeof(fn), NODE_DIR "/%s/cpulist", de->d_name);
+			if (read_line(fn, buf, sizeof(buf)) || topo_parse_cpulist(buf, set, setsize) < 0)
+				continue;
+			for (i = 0; i < nr_cpus; i++) {
+				if (CPU_ISSET_S(i, setsize, set) && cpu_node[i] >= 0)
+					cpu_node[i] = node;
+			}
+			if (node + 1 > nr_nodes)
+				nr_nodes = node + 1;
+		}
+		closedir(d);
+	}
+
+	/*
+	 * only use cpus we have been allowed to use (cpusets, containers,
+	 * taskset); our own mask means nothing for a snapshot
+	 */
+	if (root[0] != '\0' || sched_getaffinity(0, setsize, inherited)) {
+		CPU_ZERO_S(setsize, inherited);
+		for (i = 0; i < nr_cpus; i++) {
+			CPU_SET_S(i, setsize, inherited);
+		}
+	}
+	CPU_ZERO_S(setsize, usable);
+	nr_usable = 0;
+	for (i = 0; i < nr_cpus; i++) {
+		if (cpu_node[i] >= 0 && CPU_ISSET_S(i, setsize, inherited)) {
+			CPU_SET_S(i, setsize, usable);
+			nr_usable++;
+		}
+	}
+
+	CPU_ZERO_S(setsize, isolated);
+	for (k = 0; k < 2; k++) {
+		if (read_line(topo_path(fn, sizeof(fn), k ? CPU_NOHZ_FULL : CPU_ISOLATED), buf, sizeof(buf)) || topo_parse_cpulist(buf, set, setsize) <= 0)
+			continue;
+		for (i = 0; i < nr_cpus; i++) {
+			if (CPU_ISSET_S(i, setsize, set) && cpu_node[i] >= 0)
+				CPU_SET_S(i, setsize, isolated);
+		}
+	}
+
+	CPU_FREE(set);
+	CPU_FREE(inherited);
+
+	return 0;
+}
+
+int topo_nr_cpus(void)
+{
+	return nr_cpus;
+}
+
+int topo_nr_nodes(void)
+{
+	return nr_nodes;
+}
+
+int topo_nr_usable(void)
+{
+	return nr_usable;
+}
+
+int topo_cpu_node(int cpu)
+{
+	if (cpu < 0 || cpu >= nr_cpus || cpu_node[cpu] < 0)
+		return 0;
+	return cpu_node[cpu];
+}
+
+int topo_cpu_online(int cpu)
+{
+	if (cpu < 0 || cpu >= nr_cpus)
+		return 0;
+	return cpu_node[cpu] >= 0;
+}
+
+/* whether 'cpu' is kept free of kernel housekeeping (isolcpus, nohz_full) */
+int topo_cpu_isolated(int cpu)
+{
+	if (cpu < 0 || cpu >= nr_cpus) {
+		return 0;
+	}
+	return CPU_ISSET_S(cpu, setsize, isolated);
+}
+
+/*
+ * Makes isolated cpus usable even if outside inherited affinity mask (init
+ * keeps itself, and so everything it starts, off them). Returns number of
+ * cpus added.
+ */
+int topo_use_isolated(void)
+{
+	int i, n = 0;
+
+	for (i = 0; i < nr_cpus; i++) {
+		if (CPU_ISSET_S(i, setsize, isolated) && !CPU_ISSET_S(i, setsize, usable)) {
+			CPU_SET_S(i, setsize, usable);
+			nr_usable++;
+			n++;
+		}
+	}
+	if (n) {
+		/* capacities are relative to usable cpus */
+		free(cpu_cap);
+		cpu_cap = NULL;
+		free(cpu_class);
+		cpu_class = NULL;
+		nr_classes = 1;
+	}
+	return n;
+}
+
+int topo_cpu_usable(int cpu)
+{
+	if (cpu < 0 || cpu >= nr_cpus)
+		return 0;
+	return CPU_ISSET_S(cpu, setsize, usable);
+}
+
+/*
+ * Returns identifier (lowest cpu) of last level cache group 'cpu' belongs
+ * to; cpus without cache information form their own group.
+ */
+int topo_cpu_llc(int cpu)
+{
+	if (cpu < 0 || cpu >= nr_cpus)
+		return -1;
+	if (!cpu_llc) {
+		cpu_set_t *set = CPU_ALLOC(nr_cpus);
+		int i;
+
+		cpu_llc = malloc(nr_cpus * sizeof(*cpu_llc));
+		for (i = 0; i < nr_cpus; i++) {
+			char fn[PATH_MAX];
+			char buf[4096];
+			int idx, level, best = 0;
+
+			cpu_llc[i] = i;
+			if (cpu_node[i] < 0)
+				continue;
+			for (idx = 0; ; idx++) {
+				topo_path(fn, sizeof(fn), CPU_DIR "/cpu%d/cache/index%d/level", i, idx);
+				if (read_line(fn, buf, sizeof(buf)))
+					break;
+				level = atoi(buf);
+				if (level <= best)
+					continue;
+				topo_path(fn, sizeof(fn), CPU_DIR "/cpu%d/cache/index%d/shared_cpu_list", i, idx);
+				if (read_line(fn, buf, sizeof(buf)) || topo_parse_cpulist(buf, set, setsize) <= 0)
+					continue;
+				best = level;
+				for (cpu_llc[i] = 0; cpu_llc[i] < nr_cpus && !CPU_ISSET_S(cpu_llc[i], setsize, set); cpu_llc[i]++)
+					;
+			}
+		}
+		CPU_FREE(set);
+	}
+	return cpu_llc[cpu];
+}
+
+/*
+ * Returns identifier (lowest cpu) of the core 'cpu' belongs to, i.e. the
+ * same value for all SMT siblings (or CMT module on AMD Bulldozer).
+ */
+int topo_cpu_core(int cpu)
+{
+	if (cpu < 0 || cpu >= nr_cpus)
+		return -1;
+	if (!cpu_core) {
+		cpu_set_t *set = CPU_ALLOC(nr_cpus);
+		int i;
+
+		cpu_core = malloc(nr_cpus * sizeof(*cpu_core));
+		for (i = 0; i < nr_cpus; i++) {
+			char fn[PATH_MAX];
+			char buf[4096];
+
+			cpu_core[i] = i;
+			if (cpu_node[i] < 0)
+				continue;
+			topo_path(fn, sizeof(fn), CPU_DIR "/cpu%d/topology/thread_siblings_list", i);
+			if (read_line(fn, buf, sizeof(buf)) || topo_parse_cpulist(buf, set, setsize) <= 0)
+				continue;
+			for (cpu_core[i] = 0; cpu_core[i] < nr_cpus && !CPU_ISSET_S(cpu_core[i], setsize, set); cpu_core[i]++)
+				;
+		}
+		CPU_FREE(set);
+	}
+	return cpu_core[cpu];
+}
+
+static const char *cap_files[] = { "cpu_capacity", "acpi_cppc/highest_perf", "cpufreq/cpuinfo_max_freq", NULL };
+
+static void cap_init(void)
+{
+	cpu_set_t *set = CPU_ALLOC(nr_cpus);
+	long *raw = calloc(nr_cpus, sizeof(*raw));
+	long max = 0;
+	char fn[PATH_MAX];
+	char buf[4096];
+	int src, i, atom;
+
+	cpu_cap = malloc(nr_cpus * sizeof(*cpu_cap));
+	cpu_class = calloc(nr_cpus, sizeof(*cpu_class));
+
+	/* first source available for all usable cpus */
+	for (src = 0; cap_files[src]; src++) {
+		for (i = 0; i < nr_cpus; i++) {
+			raw[i] = 0;
+			if (!CPU_ISSET_S(i, setsize, usable))
+				continue;
+			topo_path(fn, sizeof(fn), CPU_DIR "/cpu%d/%s", i, cap_files[src]);
+			if (read_line(fn, buf, sizeof(buf)) || (raw[i] = atol(buf)) <= 0)
+				break;
+		}
+		if (i == nr_cpus)
+			break;
+	}
+	for (i = 0; i < nr_cpus; i++) {
+		long limit, hw;
+
+		if (!cap_files[src])
+			raw[i] = 1;
+		/* cpufreq limits set by the user (or firmware) */
+		if (!read_line(topo_path(fn, sizeof(fn), CPU_DIR "/cpu%d/cpufreq/scaling_max_freq", i), buf, sizeof(buf)) && (limit = atol(buf)) > 0 &&
+				!read_line(topo_path(fn, sizeof(fn), CPU_DIR "/cpu%d/cpufreq/cpuinfo_max_freq", i), buf, sizeof(buf)) && (hw = atol(buf)) > limit) {
+			raw[i] = raw[i] * limit / hw;
+		}
+		if (CPU_ISSET_S(i, setsize, usable) && raw[i] > max)
+			max = raw[i];
+	}
+
+	atom = !read_line(topo_path(fn, sizeof(fn), CPU_ATOM), buf, sizeof(buf)) && topo_parse_cpulist(buf, set, setsize) > 0;
+	for (i = 0; i < nr_cpus; i++) {
+		cpu_cap[i] = max > 0 && raw[i] > 0 ? raw[i] * 1024 / max : 1024;
+		if (atom)
+			cpu_class[i] = CPU_ISSET_S(i, setsize, set) ? 1 : 0;
+		else
+			cpu_class[i] = cpu_cap[i] * 100 < CLASS_RATIO * 1024 ? 1 : 0;
+		if (CPU_ISSET_S(i, setsize, usable) && cpu_class[i] + 1 > nr_classes)
+			nr_classes = cpu_class[i] + 1;
+	}
+	free(raw);
+	CPU_FREE(set);
+}
+
+/*
+ * Returns capacity of 'cpu' relative to the most capable usable cpu (1024)
+ * as told by, in order of preference, cpu_capacity, ACPI CPPC highest_perf
+ * (preferred cores) or cpufreq maximum frequency -- whichever is available
+ * for all cpus -- and lowered by cpufreq limits.
+ */
+int topo_cpu_capacity(int cpu)
+{
+	if (cpu < 0 || cpu >= nr_cpus)
+		return 0;
+	if (!cpu_cap)
+		cap_init();
+	return cpu_cap[cpu];
+}
+
+/*
+ * Returns class of 'cpu': 0 for performance cores, 1 for efficiency cores
+ * (cpu_atom on hybrid Intel parts; otherwise cpus well below top capacity).
+ */
+int topo_cpu_class(int cpu)
+{
+	if (cpu < 0 || cpu >= nr_cpus)
+		return 0;
+	if (!cpu_class)
+		cap_init();
+	return cpu_class[cpu];
+}
+
+/* number of classes among usable cpus */
+int topo_nr_classes(void)
+{
+	if (!cpu_class)
+		cap_init();
+	return nr_classes;
+}
+
+/* binds 'pid' (0 being the calling thread) to usable cpus of 'class' */
+int topo_bind_class(pid_t pid, int class)
+{
+	cpu_set_t *set;
+	int i, n = 0, rv = -1;
+
+	set = CPU_ALLOC(nr_cpus);
+	CPU_ZERO_S(setsize, set);
+	for (i = 0; i < nr_cpus; i++) {
+		if (topo_cpu_class(i) == class && CPU_ISSET_S(i, setsize, usable)) {
+			CPU_SET_S(i, setsize, set);
+			n++;
+		}
+	}
+	if (n) {
+		rv = sched_setaffinity(pid, setsize, set);
+	}
+	CPU_FREE(set);
+	return rv;
+}
+
+/* returns first usable cpu equal to or greater than 'cpu' or -1 if there's none */
+int topo_next_usable(int cpu)
+{
+	if (cpu < 0)
+		cpu = 0;
+	for (; cpu < nr_cpus; cpu++) {
+		if (CPU_ISSET_S(cpu, setsize, usable))
+			return cpu;
+	}
+	return -1;
+}
+
+/* binds 'pid' (0 being the calling thread) to 'cpu' */
+int topo_bind(pid_t pid, int cpu)
+{
+	cpu_set_t *set;
+	int rv;
+
+	if (cpu < 0 || cpu >= nr_cpus) {
+		return -1;
+	}
+	set = CPU_ALLOC(nr_cpus);
+	CPU_ZERO_S(setsize, set);
+	CPU_SET_S(cpu, setsize, set);
+	rv = sched_setaffinity(pid, setsize, set);
+	CPU_FREE(set);
+	return rv;
+}
+
+/* binds 'pid' (0 being the calling thread) to usable cpus of 'node' */
+int topo_bind_node(pid_t pid, int node)
+{
+	cpu_set_t *set;
+	int i, n = 0, rv = -1;
+
+	set = CPU_ALLOC(nr_cpus);
+	CPU_ZERO_S(setsize, set);
+	for (i = 0; i < nr_cpus; i++) {
+		if (cpu_node[i] == node && CPU_ISSET_S(i, setsize, usable)) {
+			CPU_SET_S(i, setsize, set);
+			n++;
+		}
+	}
+	if (n) {
+		rv = sched_setaffinity(pid, setsize, set);
+	}
+	CPU_FREE(set);
+	return rv;
+}
+
+/*
+ * Returns node the page at 'addr' in process 'pid' resides on
+ * or -1 if the page isn't present (or the query failed).
+ */
+int topo_page_node(pid_t pid, unsigned long addr)
+{
+	void *page = (void *)(addr & ~((unsigned long)sysconf(_SC_PAGESIZE) - 1));
+	int status = -1;
+
+	if (syscall(SYS_move_pages, pid, 1, &page, NULL, &status, 0)) {
+		return -1;
+	}
+	return status < 0 ? -1 : status;
+}
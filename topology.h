@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __TOPOLOGY_H
+#define __TOPOLOGY_H
+
+#include <sched.h>
+#include <sys/types.h>
+
+#define TOPO_MAX_NODES 64
+
+void topo_set_root(const char *dir);
+const char *topo_root(void);
+char *topo_path(char *buf, size_t size, const char *fmt, ...);
+int topo_init(void);
+int topo_nr_cpus(void);
+int topo_nr_nodes(void);
+int topo_nr_usable(void);
+int topo_cpu_node(int cpu);
+int topo_cpu_online(int cpu);
+int topo_cpu_usable(int cpu);
+int topo_cpu_isolated(int cpu);
+int topo_use_isolated(void);
+int topo_cpu_llc(int cpu);
+int topo_cpu_core(int cpu);
+int topo_cpu_capacity(int cpu);
+int topo_cpu_class(int cpu);
+int topo_nr_classes(void);
+int topo_next_usable(int cpu);
+int topo_bind(pid_t pid, int cpu);
+int topo_bind_node(pid_t pid, int node);
+int topo_bind_class(pid_t pid, int class);
+int topo_page_node(pid_t pid, unsigned long addr);
+int topo_parse_cpulist(const char *s, cpu_set_t *set, size_t size);
+char *topo_format_cpulist(const cpu_set_t *set, size_t size, char *buf, size_t bufsize);
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Startup warm-up: FahCore binary, WU data and checkpoints are read into
+ * page cache while FahCore starts so it doesn't wait on cold reads. Files
+ * are read in parallel by processes bound to the node of the cpu FahCore's
+ * master thread will run on, so page cache lands where it's used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "warmup.h"
+#include "topology.h"
+#include "llog.h"
+
+#define WORK_GLOB "work/*"
+#define WARMUP_JOBS 4 /* files read at once */
+#define WARMUP_MAX 64 /* files */
+#define CHUNK (1 << 20)
+
+static int wanted(const char *fn)
+{
+	const char *base = strrchr(fn, '/') ? strrchr(fn, '/') + 1 : fn;
+	size_t len = strlen(base);
+
+	if (!strncmp(base, "wudata_", 7))
+		return 1;
+	/* checkpoints */
+	return len > 4 && (!strcmp(base + len - 4, ".cpt") || !strcmp(base + len - 4, ".ckp"));
+}
+
+/* bytes of 'fd' ('size' bytes long) already in page cache */
+static long cached(int fd, off_t size)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	size_t n = (size + page - 1) / page;
+	unsigned char *vec;
+	void *p;
+	long r = 0;
+	size_t i;
+
+	if (size == 0)
+		return 0;
+	p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return 0;
+	vec = malloc(n);
+	if (vec && !mincore(p, size, vec)) {
+		for (i = 0; i < n; i++) {
+			if (vec[i] & 1)
+				r += page;
+		}
+	}
+	free(vec);
+	munmap(p, size);
+	return r > size ? size : r;
+}
+
+static void warm(const char *fn)
+{
+	char *buf = malloc(CHUNK);
+	off_t off = 0;
+	ssize_t n;
+	int fd;
+
+	fd = open(fn, O_RDONLY | O_CLOEXEC);
+	if (fd == -1 || !buf)
+		_exit(1);
+	/* start I/O for the whole file, then wait for it */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	readahead(fd, 0, CHUNK);
+	while ((n = pread(fd, buf, CHUNK, off)) > 0) {
+		off += n;
+	}
+	_exit(0);
+}
+
+/*
+ * Starts warm-up job reading 'bin' and WU files under work/ on behalf of
+ * a thread running on 'node'; fills 'w' for warmup_report(). Returns job's
+ * PID, 0 if there's nothing to read or -1.
+ */
+pid_t warmup_start(const char *bin, int node, struct warmup *w)
+{
+	char *files[WARMUP_MAX];
+	glob_t g;
+	pid_t wpid;
+	int nfiles = 0, running = 0, i;
+	size_t k;
+
+	memset(w, 0, sizeof(*w));
+	w->node = node;
+	files[nfiles++] = (char *)bin;
+	if (!glob(WORK_GLOB, 0, NULL, &g)) {
+		for (k = 0; k < g.gl_pathc && nfiles < WARMUP_MAX; k++) {
+			if (wanted(g.gl_pathv[k]))
+				files[nfiles++] = g.gl_pathv[k];
+		}
+	}
+	for (i = 0; i < nfiles; i++) {
+		struct stat st;
+		int fd = open(files[i], O_RDONLY | O_CLOEXEC);
+
+		if (fd == -1)
+			continue;
+		if (!fstat(fd, &st) && S_ISREG(st.st_mode)) {
+			w->files++;
+			w->bytes += st.st_size;
+			w->cached += cached(fd, st.st_size);
+		}
+		close(fd);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &w->start);
+	if (w->files == 0 || w->cached == w->bytes) {
+		globfree(&g);
+		return 0;
+	}
+
+	wpid = fork();
+	if (wpid != 0) {
+		globfree(&g);
+		return wpid;
+	}
+
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGHUP, SIG_DFL);
+	signal(SIGTSTP, SIG_DFL);
+	signal(SIGALRM, SIG_DFL);
+	prctl(PR_SET_PDEATHSIG, SIGHUP);
+	if (node >= 0) {
+		topo_bind_node(0, node);
+	}
+
+	for (i = 0; i < nfiles; i++) {
+		if (running == WARMUP_JOBS) {
+			wait(NULL);
+			running--;
+		}
+		if (fork() == 0) {
+			warm(files[i]);
+		}
+		running++;
+	}
+	while (wait(NULL) > 0)
+		;
+	_exit(0);
+}
+
+/* reports on warm-up 'w' */
+void warmup_report(pid_t rv, struct warmup *w)
+{
+	long pct = w->bytes ? w->cached * 100 / w->bytes : 100;
+
+	if (!w->done) {
+		llog("thekraken: %d: warm-up of %d file(s) (%ld MB, %ld%% cached beforehand) still in progress\n", rv, w->files, w->bytes >> 20, pct);
+		return;
+	}
+	llog("thekraken: %d: warm-up read %d file(s) (%ld MB, %ld%% cached beforehand) into node %d page cache in %ld ms, up to that much cold reading kept off FahCore startup\n", rv, w->files, w->bytes >> 20, pct, w->node, w->ms);
+}
+
+/* to be called once warm-up job has been reaped */
+void warmup_done(struct warmup *w)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	w->ms = (t.tv_sec - w->start.tv_sec) * 1000 + (t.tv_nsec - w->start.tv_nsec) / 1000000;
+	w->done = 1;
+}
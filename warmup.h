@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __WARMUP_H
+#define __WARMUP_H
+
+#include <sys/types.h>
+#include <time.h>
+
+struct warmup {
+	int node;		/* page cache filled on */
+	int files;
+	long bytes;
+	long cached;		/* bytes in page cache before warm-up */
+	struct timespec start;
+	long ms;		/* time it took */
+	int done;
+};
+
+pid_t warmup_start(const char *bin, int node, struct warmup *w);
+void warmup_done(struct warmup *w);
+void warmup_report(pid_t rv, struct warmup *w);
+
+#endif
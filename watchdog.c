@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Mid-run progress watchdog. Once FahCore reported its first step, its
+ * logfile is tailed every WATCHDOG_PERIOD ms (FahCore's writes are traced
+ * only until DLB engages) and 'Completed' lines are timed. If none shows
+ * up within 'factor' times the rolling TPF (average of the last
+ * WATCHDOG_FRAMES frames), FahCore is considered stalled: state, last cpu
+ * and cpu usage since the last progress of each of its threads are
+ * logged.
+ *
+ * watchdog_restart() has FahCore checkpoint and exit (SIGINT, as on
+ * Ctrl+C) so the client restarts it. FahCore_a5 is known to write broken
+ * checkpoints at such shutdowns (see README), so the checkpoint is backed
+ * up first and watchdog_finish() puts it back if the new one looks wrong.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+#include "watchdog.h"
+#include "logscan.h"
+#include "topology.h"
+#include "llog.h"
+
+#define WATCHDOG_PERIOD 1000 /* ms */
+#define WATCHDOG_FRAMES 5
+#define WATCHDOG_THREADS 256
+#define CKP_FMT "work/wudata_%s.ckp"
+#define CKP_BACKUP_SUFFIX ".kraken"
+#define CKP_SIZE_A5 75160
+
+struct thread {
+	int tid;
+	unsigned long ticks;	/* utime + stime */
+};
+
+static int tfd = -1;
+static pid_t core_pid;
+static int stall_factor;
+
+static char logfn[32];
+static char ckpfn[32];
+static off_t logoff;
+static struct logscan ls;
+
+static long tpf[WATCHDOG_FRAMES]; /* ms, ring */
+static int ntpf;
+static long last; /* ms; last progress */
+static int stalled;
+static int restarting;
+
+/* cpu time of FahCore's threads at the last progress */
+static struct thread threads[WATCHDOG_THREADS];
+static int nthreads;
+
+static long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* state, ticks and processor of thread 'tid'; -1 if it's gone */
+static int thread_stat(int tid, char *state, unsigned long *ticks, int *cpu)
+{
+	char fn[PATH_MAX], buf[512];
+	char *s, *save;
+	int i;
+	FILE *fp;
+
+	topo_path(fn, sizeof(fn), "/proc/%d/task/%d/stat", core_pid, tid);
+	fp = fopen(fn, "r");
+	if (!fp) {
+		return -1;
+	}
+	s = NULL;
+	if (fgets(buf, sizeof(buf), fp))
+		s = strrchr(buf, ')');
+	fclose(fp);
+	if (!s) {
+		return -1;
+	}
+	/* field 3 follows the closing parenthesis */
+	*ticks = 0;
+	*cpu = -1;
+	for (i = 3, s = strtok_r(s + 1, " ", &save); s; i++, s = strtok_r(NULL, " ", &save)) {
+		if (i == 3)
+			*state = s[0];
+		else if (i == 14 || i == 15)
+			*ticks += strtoul(s, NULL, 10);
+		else if (i == 39)
+			*cpu = atoi(s);
+	}
+	return 0;
+}
+
+/* calls 'fn' for every thread of FahCore */
+static void for_each_thread(void (*fn)(int tid))
+{
+	char path[PATH_MAX];
+	struct dirent *de;
+	DIR *d;
+
+	topo_path(path, sizeof(path), "/proc/%d/task", core_pid);
+	d = opendir(path);
+	if (!d) {
+		return;
+	}
+	while ((de = readdir(d))) {
+		if (isdigit(de->d_name[0]))
+			fn(atoi(de->d_name));
+	}
+	closedir(d);
+}
+
+static void snapshot_one(int tid)
+{
+	char state;
+	int cpu;
+
+	if (nthreads < WATCHDOG_THREADS && !thread_stat(tid, &state, &threads[nthreads].ticks, &cpu)) {
+		threads[nthreads++].tid = tid;
+	}
+}
+
+static void snapshot(void)
+{
+	nthreads = 0;
+	for_each_thread(snapshot_one);
+}
+
+static void report_one(int tid)
+{
+	static long hz;
+	unsigned long ticks, prev;
+	long ms = now_ms() - last;
+	char state;
+	int cpu, i;
+
+	if (thread_stat(tid, &state, &ticks, &cpu)) {
+		return;
+	}
+	for (i = 0; i < nthreads && threads[i].tid != tid; i++)
+		;
+	if (i == nthreads) {
+		/* no baseline; its whole lifetime isn't 'since last progress' */
+		llog("thekraken: watchdog: %d: state %c, cpu %d, new since last progress\n", tid, state, cpu);
+		return;
+	}
+	prev = threads[i].ticks;
+	if (!hz) {
+		hz = sysconf(_SC_CLK_TCK);
+	}
+	llog("thekraken: watchdog: %d: state %c, cpu %d, %ld%% cpu since last progress\n", tid, state, cpu, ms > 0 ? (long)((ticks - prev) * 100000 / hz / ms) : 0);
+}
+
+/*
+ * Starts watching progress of FahCore 'pid' (logfile_'slot'.txt); to be
+ * called once the first step has been reported. Returns -1 if the timer
+ * can't be set up.
+ */
+int watchdog_start(pid_t pid, const char *slot, int factor)
+{
+	struct itimerspec its;
+	char buf[4096];
+	ssize_t n;
+	int fd;
+
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (tfd == -1) {
+		return -1;
+	}
+	its.it_value.tv_sec = its.it_interval.tv_sec = WATCHDOG_PERIOD / 1000;
+	its.it_value.tv_nsec = its.it_interval.tv_nsec = WATCHDOG_PERIOD % 1000 * 1000000;
+	timerfd_settime(tfd, 0, &its, NULL);
+
+	core_pid = pid;
+	stall_factor = factor;
+	snprintf(logfn, sizeof(logfn), "work/logfile_%s.txt", slot);
+	snprintf(ckpfn, sizeof(ckpfn), CKP_FMT, slot);
+	logscan_init(&ls, "watchdog");
+	logoff = 0;
+	fd = open(logfn, O_RDONLY | O_CLOEXEC);
+	if (fd != -1) {
+		while ((n = pread(fd, buf, sizeof(buf), logoff)) > 0) {
+			logoff += n;
+			logscan_feed(&ls, buf, n);
+		}
+		close(fd);
+	}
+	ntpf = 0;
+	stalled = 0;
+	last = now_ms();
+	snapshot();
+	return 0;
+}
+
+int watchdog_fd(void)
+{
+	return tfd;
+}
+
+/*
+ * Looks for progress if watchdog_fd() is readable. Returns 1 when
+ * FahCore has just been found stalled, 0 otherwise.
+ */
+int watchdog_tick(void)
+{
+	unsigned long long expirations;
+	char buf[4096];
+	long now, sum;
+	ssize_t n;
+	int fd, i, frames = ls.steps;
+
+	if (tfd == -1 || read(tfd, &expirations, sizeof(expirations)) <= 0) {
+		return 0;
+	}
+	fd = open(logfn, O_RDONLY | O_CLOEXEC);
+	if (fd != -1) {
+		while ((n = pread(fd, buf, sizeof(buf), logoff)) > 0) {
+			logoff += n;
+			logscan_feed(&ls, buf, n);
+		}
+		close(fd);
+	}
+	frames = ls.steps - frames;
+	now = now_ms();
+	if (frames) {
+		if (stalled) {
+			/* not a frame time worth averaging */
+			llog("thekraken: watchdog: progress resumed after %lds\n", (now - last) / 1000);
+			stalled = 0;
+		} else {
+			/* several frames completed within one tick share its time */
+			for (i = 0; i < frames && i < WATCHDOG_FRAMES; i++) {
+				tpf[ntpf++ % WATCHDOG_FRAMES] = (now - last) / frames;
+			}
+		}
+		last = now;
+		snapshot();
+		return 0;
+	}
+	if (stalled || ntpf == 0) {
+		/* no frame timed yet; startup_deadline covers the time until the first step */
+		return 0;
+	}
+	sum = 0;
+	for (i = 0; i < ntpf && i < WATCHDOG_FRAMES; i++) {
+		sum += tpf[i];
+	}
+	sum /= i;
+	if (now - last <= stall_factor * sum) {
+		return 0;
+	}
+	stalled = 1;
+	llog("thekraken: watchdog: %d: no progress for %lds (rolling TPF %.1fs); FahCore stalled\n", core_pid, (now - last) / 1000, sum / 1000.0);
+	for_each_thread(report_one);
+	return 1;
+}
+
+static int copy(const char *from, const char *to)
+{
+	char buf[4096];
+	ssize_t n;
+	int in, out, ret = 0;
+
+	in = open(from, O_RDONLY | O_CLOEXEC);
+	if (in == -1) {
+		return -1;
+	}
+	out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (out == -1) {
+		close(in);
+		return -1;
+	}
+	while ((n = read(in, buf, sizeof(buf))) > 0) {
+		if (write(out, buf, n) != n) {
+			ret = -1;
+			break;
+		}
+	}
+	if (n < 0) {
+		ret = -1;
+	}
+	close(in);
+	if (close(out)) {
+		ret = -1;
+	}
+	return ret;
+}
+
+/*
+ * Backs up FahCore's checkpoint and has FahCore checkpoint and exit.
+ * Returns -1 if FahCore couldn't be signalled.
+ */
+int watchdog_restart(void)
+{
+	char bak[48];
+
+	if (tfd == -1 || restarting) {
+		return 0;
+	}
+	snprintf(bak, sizeof(bak), "%s" CKP_BACKUP_SUFFIX, ckpfn);
+	if (copy(ckpfn, bak)) {
+		unlink(bak);
+		llog("thekraken: watchdog: no checkpoint backed up (%s)\n", ckpfn);
+	} else {
+		llog("thekraken: watchdog: checkpoint backed up to %s\n", bak);
+	}
+	llog("thekraken: watchdog: %d: asking FahCore to checkpoint and exit\n", core_pid);
+	restarting = 1;
+	return kill(core_pid, SIGINT);
+}
+
+/*
+ * To be called once FahCore 'core' exited. After watchdog_restart(),
+ * restores the backed up checkpoint if FahCore left a broken one
+ * (missing, shorter than the backup or, for A5, not CKP_SIZE_A5 bytes
+ * long).
+ */
+void watchdog_finish(const char *core)
+{
+	const char *u = strrchr(core, '_');
+	char bak[48];
+	struct stat st, bst;
+	int broken;
+
+	if (!restarting) {
+		return;
+	}
+	restarting = 0;
+	snprintf(bak, sizeof(bak), "%s" CKP_BACKUP_SUFFIX, ckpfn);
+	if (stat(bak, &bst)) {
+		return;
+	}
+	broken = stat(ckpfn, &st) || st.st_size < bst.st_size;
+	if (!broken && u && !strcasecmp(u + 1, "a5")) {
+		broken = st.st_size != CKP_SIZE_A5;
+	}
+	if (!broken) {
+		llog("thekraken: watchdog: checkpoint %s written (%ld bytes)\n", ckpfn, (long)st.st_size);
+		unlink(bak);
+	} else if (rename(bak, ckpfn)) {
+		llog("thekraken: watchdog: checkpoint %s broken, cannot restore %s: %s\n", ckpfn, bak, strerror(errno));
+	} else {
+		llog("thekraken: watchdog: checkpoint %s broken; restored the one backed up\n", ckpfn);
+	}
+}
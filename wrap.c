@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Wrapper installation helpers: telling wrapped cores from unwrapped ones
+ * by content (marker section) and copying ourselves into place cheaply.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <elf.h>
+#include <link.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#include "wrap.h"
+#include "version.h"
+
+#define LEGACY_SIZE 204800 /* wrappers predating the marker are smaller than this */
+#define LEGACY_TAG "Processor affinity wrapper for Folding@Home"
+#define MAX_SHSTRTAB 65536
+
+const char wrap_marker[] __attribute__ ((section(WRAP_SECTION), used)) = "thekraken " VERSION;
+
+/* copies section 'name' of ELF file 'fd' into 'buf'; returns -1 if there's no such section */
+static int elf_section(int fd, const char *name, char *buf, int size)
+{
+	ElfW(Ehdr) eh;
+	ElfW(Shdr) *sh = NULL;
+	char *strtab = NULL;
+	int i, rv = -1;
+
+	if (pread(fd, &eh, sizeof(eh), 0) != sizeof(eh) || memcmp(eh.e_ident, ELFMAG, SELFMAG))
+		return -1;
+	if (eh.e_ident[EI_CLASS] != (sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32))
+		return -1;
+	if (eh.e_shentsize != sizeof(*sh) || !eh.e_shnum || eh.e_shstrndx >= eh.e_shnum)
+		return -1;
+
+	sh = malloc(eh.e_shnum * sizeof(*sh));
+	if (!sh || pread(fd, sh, eh.e_shnum * sizeof(*sh), eh.e_shoff) != eh.e_shnum * sizeof(*sh))
+		goto out;
+	if (sh[eh.e_shstrndx].sh_size > MAX_SHSTRTAB)
+		goto out;
+	strtab = calloc(1, sh[eh.e_shstrndx].sh_size + 1);
+	if (!strtab || pread(fd, strtab, sh[eh.e_shstrndx].sh_size, sh[eh.e_shstrndx].sh_offset) != sh[eh.e_shstrndx].sh_size)
+		goto out;
+	for (i = 0; i < eh.e_shnum; i++) {
+		if (sh[i].sh_name >= sh[eh.e_shstrndx].sh_size || strcmp(strtab + sh[i].sh_name, name))
+			continue;
+		if (sh[i].sh_size >= size)
+			break;
+		if (pread(fd, buf, sh[i].sh_size, sh[i].sh_offset) == sh[i].sh_size) {
+			buf[sh[i].sh_size] = '\0';
+			rv = 0;
+		}
+		break;
+	}
+out:
+	free(strtab);
+	free(sh);
+	return rv;
+}
+
+/* whether small file 'fd' contains wrapper's banner */
+static int legacy(int fd, off_t len)
+{
+	char *buf;
+	int rv = 0;
+
+	if (len >= LEGACY_SIZE)
+		return 0;
+	buf = malloc(len);
+	if (buf && pread(fd, buf, len, 0) == len) {
+		rv = memmem(buf, len, LEGACY_TAG, strlen(LEGACY_TAG)) != NULL;
+	}
+	free(buf);
+	return rv;
+}
+
+/*
+ * Tells whether 'name' (relative to 'dfd') is The Kraken: WRAP_MARKED
+ * (marker copied to 'tag'), WRAP_LEGACY (older version without marker)
+ * or WRAP_NONE. Returns -1 if the file can't be read.
+ */
+int wrap_check(int dfd, const char *name, char *tag, int size)
+{
+	struct stat st;
+	int fd, rv = WRAP_NONE;
+
+	fd = openat(dfd, name, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	if (!elf_section(fd, WRAP_SECTION, tag, size)) {
+		rv = WRAP_MARKED;
+	} else if (legacy(fd, st.st_size)) {
+		rv = WRAP_LEGACY;
+	}
+	close(fd);
+	return rv;
+}
+
+/*
+ * Creates 'name' (relative to 'dfd'; must not exist) as a copy of running
+ * executable: reflink if the filesystem can, copy_file_range() otherwise,
+ * read()/write() as a last resort. Removes 'name' on failure.
+ */
+int wrap_copy_self(int dfd, const char *name)
+{
+	struct stat st;
+	char buf[65536];
+	int in, out, rv = -1;
+	ssize_t n = 0;
+	off_t done = 0;
+
+	in = open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+	if (in == -1)
+		return -1;
+	out = openat(dfd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRWXU | S_IRWXG | S_IRWXO);
+	if (out == -1 || fstat(in, &st))
+		goto out;
+
+	if (!ioctl(out, FICLONE, in)) {
+		rv = 0;
+		goto out;
+	}
+	while (done < st.st_size && (n = copy_file_range(in, NULL, out, NULL, st.st_size - done, 0)) > 0) {
+		done += n;
+	}
+	if (n == -1 && done == 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+		while ((n = read(in, buf, sizeof(buf))) > 0) {
+			if (write(out, buf, n) != n)
+				break;
+			done += n;
+		}
+	}
+	if (done == st.st_size)
+		rv = 0;
+out:
+	close(in);
+	if (out != -1) {
+		if (close(out))
+			rv = -1;
+		if (rv)
+			unlinkat(dfd, name, 0);
+	}
+	return rv;
+}
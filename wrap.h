@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2013 by Kris Rusocki <kszysiu@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __WRAP_H
+#define __WRAP_H
+
+#define WRAP_SECTION ".thekraken"
+
+#define WRAP_NONE 0
+#define WRAP_MARKED 1
+#define WRAP_LEGACY 2
+
+extern const char wrap_marker[];
+
+int wrap_check(int dfd, const char *name, char *tag, int size);
+int wrap_copy_self(int dfd, const char *name);
+
+#endif